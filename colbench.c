@@ -0,0 +1,166 @@
+/*-----------------------------------------------------------------------------
+ *
+ *
+ *  Copyright (C) 2024 Frenkel Smeijers
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Benchmark of the column drawers and I_FinishUpdate of POSIX hosts.
+ *      Draws frames that look like a room, a ceiling, walls and a floor
+ *      in every column with sprites in front of them,
+ *      and prints the time per frame for the layout of the view window
+ *      it has been built with.
+ *
+ *      This is a host tool, it is not part of the game.
+ *
+ *-----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "compiler.h"
+
+#include "i_system.h"
+#include "r_main.h"
+
+
+#define FRAMES 20000
+#define RUNS   5
+
+#define NUMSPRITECOLUMNS (VIEWWINDOWWIDTH / 2)
+
+#if defined COLUMN_MAJOR
+#define LAYOUT "columns"
+#else
+#define LAYOUT "rows"
+#endif
+
+const int16_t CENTERY = VIEWWINDOWHEIGHT / 2;
+
+const uint8_t __far* fullcolormap;
+
+static uint8_t colormaps[34 * 256];
+static uint8_t texture[128];
+
+static draw_column_vars_t walls[VIEWWINDOWWIDTH];
+static draw_column_vars_t sprites[NUMSPRITECOLUMNS];
+
+
+static uint64_t GetNanoseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+static void SetupFrame(void)
+{
+	for (int i = 0; i < 34 * 256; i++)
+		colormaps[i] = rand();
+	fullcolormap = colormaps;
+
+	for (int i = 0; i < 128; i++)
+		texture[i] = rand();
+
+	for (int16_t x = 0; x < VIEWWINDOWWIDTH; x++)
+	{
+		// walls between a quarter and all of the height of the view window
+		int16_t height = VIEWWINDOWHEIGHT / 4 + rand() % (VIEWWINDOWHEIGHT * 3 / 4);
+
+		walls[x].x          = x;
+		walls[x].yl         = CENTERY - height / 2;
+		walls[x].yh         = walls[x].yl + height - 1;
+		walls[x].iscale     = (FRACUNIT * 128) / height;
+		walls[x].texturemid = rand();
+		walls[x].source     = texture;
+		walls[x].colormap   = &colormaps[(rand() % 32) * 256];
+	}
+
+	for (int16_t i = 0; i < NUMSPRITECOLUMNS; i++)
+	{
+		sprites[i]    = walls[rand() % VIEWWINDOWWIDTH];
+		sprites[i].yl = CENTERY;
+	}
+}
+
+
+static void DrawFrame(void)
+{
+	for (int16_t x = 0; x < VIEWWINDOWWIDTH; x++)
+	{
+		draw_column_vars_t dcvars = walls[x];
+
+		dcvars.yl = 0;
+		dcvars.yh = walls[x].yl - 1;
+		R_DrawColumnFlat(x, &dcvars);
+
+		R_DrawColumn(&walls[x]);
+
+		dcvars.yl = walls[x].yh + 1;
+		dcvars.yh = VIEWWINDOWHEIGHT - 1;
+		R_DrawColumnFlat(x + 1, &dcvars);
+	}
+
+	for (int16_t i = 0; i < NUMSPRITECOLUMNS; i++)
+	{
+		if (i % 8)
+			R_DrawColumn(&sprites[i]);
+		else
+			R_DrawFuzzColumn(&sprites[i]);
+	}
+}
+
+
+int main(void)
+{
+	SetupFrame();
+
+	uint64_t bestdraw   = UINT64_MAX;
+	uint64_t bestfinish = UINT64_MAX;
+
+	for (int16_t run = 0; run < RUNS; run++)
+	{
+		uint64_t draw   = 0;
+		uint64_t finish = 0;
+
+		for (int32_t frame = 0; frame < FRAMES; frame++)
+		{
+			uint64_t start = GetNanoseconds();
+			DrawFrame();
+			uint64_t middle = GetNanoseconds();
+			I_FinishUpdate();
+			uint64_t end = GetNanoseconds();
+
+			draw   += middle - start;
+			finish += end - middle;
+		}
+
+		if (draw < bestdraw)
+			bestdraw = draw;
+		if (finish < bestfinish)
+			bestfinish = finish;
+	}
+
+	printf("%3i x %3i %-7s draw %7.0f ns  finish update %6.0f ns  frame %7.0f ns\n",
+		VIEWWINDOWWIDTH, VIEWWINDOWHEIGHT, LAYOUT,
+		(double)bestdraw / FRAMES, (double)bestfinish / FRAMES, (double)(bestdraw + bestfinish) / FRAMES);
+
+	return 0;
+}
@@ -36,9 +36,10 @@ typedef uint16_t segment_t;
 
 #else
 //32-bit
-#define D_MK_FP(s,o) (void*)((s<<4)+o)
-#define D_FP_SEG(p)  (((uint32_t)p)>>4)
-#define D_FP_OFF(p)  (((uint32_t)p)&15)
+//On 64-bit hosts the zone has to live below 4 GB, see i_posix.c
+#define D_MK_FP(s,o) (void*)((((uintptr_t)(s))<<4)+(o))
+#define D_FP_SEG(p)  ((uint32_t)(((uintptr_t)(p))>>4))
+#define D_FP_OFF(p)  (((uintptr_t)(p))&15)
 
 typedef uint32_t segment_t;
 #define SIZE_OF_SEGMENT_T 4
@@ -47,6 +48,7 @@ typedef uint32_t segment_t;
 
 #define _fmemchr	memchr
 #define _fmemcpy	memcpy
+#define _fmemmove	memmove
 #define _fmemset	memset
 #define _fstrcpy	strcpy
 #define _fstrlen	strlen
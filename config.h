@@ -2,8 +2,8 @@
 /* config.h.in.  Generated from configure.ac by autoheader.  */
 
 
-/* Uncomment this to exhaustively run memory checks while the game is running
-   (this is EXTREMELY slow). */
+/* Uncomment this to check the zone while the game is running: a few blocks
+   every tic, and the neighbours of every block that is allocated or freed. */
 /* #undef CHECKHEAP */
 
 /* Define for support for MBF helper dogs */
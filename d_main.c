@@ -38,6 +38,8 @@
  */
 
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 #include "doomdef.h"
 #include "doomtype.h"
@@ -55,10 +57,117 @@
 #include "d_main.h"
 #include "globdata.h"
 
+#if defined TIC_HASH
+#include "m_hash.h"
+#endif
+
 
 static int16_t maketic;
 
 
+#if defined FRAME_TIMING
+//
+// Per-frame timing, the duration of every phase of the last FRAMETIMES tics
+//
+
+#define FRAMETIMES 4096
+
+enum
+{
+	FT_SIMULATION,	// G_BuildTiccmd and G_Ticker
+	FT_VIEW,		// R_RenderPlayerView
+	FT_STATUSBAR,	// ST_doPaletteStuff and ST_Drawer
+	FT_FINISH,		// I_FinishUpdate
+	FT_TOTAL,
+	NUMFRAMETIMES
+};
+
+static const char* const frametimenames[NUMFRAMETIMES] =
+{
+	"simulation", "view", "status bar", "finish update", "total"
+};
+
+static uint32_t frametimes[FRAMETIMES][NUMFRAMETIMES];
+static uint16_t frametimeindex;
+static uint16_t frametimecount;
+
+static uint32_t frametimesorted[FRAMETIMES];
+
+// The end of every phase, FT_TOTAL holds the start of the tic
+static uint32_t frametimestamps[NUMFRAMETIMES];
+
+#define D_FrameTimestamp(phase) frametimestamps[phase] = I_GetMicroseconds()
+
+
+static int D_CompareFrameTimes(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a;
+	uint32_t y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+
+static void D_StoreFrameTimes(void)
+{
+	uint32_t* sample = frametimes[frametimeindex];
+	uint32_t previous = frametimestamps[FT_TOTAL];
+	for (int8_t phase = 0; phase < FT_TOTAL; phase++)
+	{
+		sample[phase] = frametimestamps[phase] - previous;
+		previous = frametimestamps[phase];
+	}
+	sample[FT_TOTAL] = previous - frametimestamps[FT_TOTAL];
+
+	frametimeindex = (frametimeindex + 1) % FRAMETIMES;
+	if (frametimecount < FRAMETIMES)
+		frametimecount++;
+}
+
+
+static uint32_t D_FrameTimePercentile(uint8_t percent)
+{
+	return frametimesorted[(frametimecount - 1) * (uint32_t)percent / 100];
+}
+
+
+void D_PrintFrameTimes(void)
+{
+	if (frametimecount == 0)
+		return;
+
+	printf("%u frames, in microseconds:   min median    p95    p99    max\n", frametimecount);
+	for (int8_t phase = 0; phase < NUMFRAMETIMES; phase++)
+	{
+		for (uint16_t i = 0; i < frametimecount; i++)
+			frametimesorted[i] = frametimes[i][phase];
+		qsort(frametimesorted, frametimecount, sizeof(uint32_t), D_CompareFrameTimes);
+
+		printf("%-24s %6lu %6lu %6lu %6lu %6lu\n", frametimenames[phase],
+			(unsigned long)frametimesorted[0],
+			(unsigned long)D_FrameTimePercentile(50),
+			(unsigned long)D_FrameTimePercentile(95),
+			(unsigned long)D_FrameTimePercentile(99),
+			(unsigned long)frametimesorted[frametimecount - 1]);
+	}
+
+	frametimeindex = 0;
+	frametimecount = 0;
+}
+
+
+// Without drawing the display phases take no time
+static void D_SkipDisplayFrameTimestamps(void)
+{
+	D_FrameTimestamp(FT_VIEW);
+	frametimestamps[FT_STATUSBAR] = frametimestamps[FT_VIEW];
+	frametimestamps[FT_FINISH]    = frametimestamps[FT_VIEW];
+}
+#else
+#define D_FrameTimestamp(phase)
+#define D_SkipDisplayFrameTimestamps()
+#endif
+
+
 static void D_BuildNewTiccmds(void)
 {
 // Somehow the Macintosh build doesn't work when this code is removed
@@ -88,20 +197,27 @@ static void D_BuildNewTiccmds(void)
 
 static void D_Display (void)
 {
+    // Outside a level nothing is drawn
+    D_FrameTimestamp(FT_VIEW);
+
     if (!G_IsGameticEqualToBasetic())
     { // In a level
 
         // Now do the drawing
         R_RenderPlayerView (&_g_player);
+        D_FrameTimestamp(FT_VIEW);
 
         ST_doPaletteStuff();
         ST_Drawer();
     }
 
+    D_FrameTimestamp(FT_STATUSBAR);
+
     D_BuildNewTiccmds();
 
     // normal update
     I_FinishUpdate ();              // page flip or blit buffer
+    D_FrameTimestamp(FT_FINISH);
 }
 
 
@@ -116,16 +232,36 @@ static void D_DoomLoop(void)
     {
         // frame syncronous IO operations
 
+        D_FrameTimestamp(FT_TOTAL);
+
         // process one or more tics
         G_BuildTiccmd ();
 
         G_Ticker ();
+        D_FrameTimestamp(FT_SIMULATION);
 
         _g_gametic++;
         maketic++;
 
         // Update display, next frame, with current state.
-        D_Display();
+        if (G_IsSimulationOnly())
+            D_SkipDisplayFrameTimestamps();
+        else
+            D_Display();
+
+#if defined TIC_HASH
+        M_TicHash();
+#endif
+
+#if defined CHECKHEAP
+        Z_CheckHeapIncremental();
+#endif
+
+#if defined FRAME_TIMING
+        // Skip the tic that (re)started the demo, it loaded the level
+        if (_g_gametic != 1)
+            D_StoreFrameTimes();
+#endif
     }
 }
 
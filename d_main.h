@@ -43,5 +43,9 @@
 
 void D_DoomMain(void);
 
+#if defined FRAME_TIMING
+void D_PrintFrameTimes(void);
+#endif
+
 
 #endif
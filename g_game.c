@@ -84,6 +84,10 @@ player_t        _g_player;
 int16_t             _g_gametic;
 static int16_t      _s_basetic;
 
+// Simulation only, the demo is replayed without drawing until this many tics have been simulated
+static uint32_t     _s_simulatetics;
+static uint32_t     _s_simulatedtics;
+
 
 static boolean gamekeydown[NUMKEYS];
 
@@ -470,6 +474,15 @@ boolean G_IsGameticEqualToBasetic(void)
 }
 
 
+static uint32_t G_CalculateFps(uint32_t gametics, uint32_t realtics)
+{
+    if (realtics == 0)
+        realtics = 1;
+
+    return (uint64_t)TICRATE * 1000 * gametics / realtics;
+}
+
+
 static void G_DoPlayDemo(void)
 {
     int16_t demolumpnum = W_GetNumForName("DEMO3");
@@ -483,19 +496,141 @@ static void G_DoPlayDemo(void)
     _g_demoplayback = true;
 
     W_CacheLumps();
-    I_StartClock();
+
+    // A simulation is timed over all replays of the demo
+    if (_s_simulatedtics == 0)
+        I_StartClock();
+}
+
+
+void G_SetSimulateTics(uint32_t tics)
+{
+    _s_simulatetics = tics;
+}
+
+
+boolean G_IsSimulationOnly(void)
+{
+    return _s_simulatetics != 0;
+}
+
+
+static void G_CheckSimulationStatus(void)
+{
+    _s_simulatedtics += (uint16_t) _g_gametic;
+
+    if (_s_simulatedtics < _s_simulatetics)
+    {
+        // Replay the demo from the start, the caller continues with its first ticcmd
+        _g_gametic = 0;
+        G_DoPlayDemo();
+        G_ReadDemoTiccmd();
+        return;
+    }
+
+    uint32_t realtics = I_EndClock();
+
+#if defined FRAME_TIMING
+    D_PrintFrameTimes();
+#endif
+
+    uint32_t resultticspersecond = G_CalculateFps(_s_simulatedtics, realtics);
+    I_Error ("Simulated %lu gametics in %lu realtics = %lu.%.3lu tics per second",
+             (unsigned long) _s_simulatedtics, (unsigned long) realtics,
+             (unsigned long) (resultticspersecond / 1000), (unsigned long) (resultticspersecond % 1000));
+}
+
+
+// The first run starts with only the CACHE lumps in memory,
+// later runs find the lumps and composed columns of the previous run.
+static int16_t  _s_timedemoruns = 1;
+static int16_t  _s_timedemorun;
+
+static uint32_t _s_coldfps;
+static uint32_t _s_warmgametics;
+static uint32_t _s_warmrealtics;
+static uint32_t _s_warmminfps;
+static uint32_t _s_warmmaxfps;
+
+
+void G_SetTimedemoRuns(int16_t runs)
+{
+    _s_timedemoruns = runs < 1 ? 1 : runs;
 }
 
+
 /* G_CheckDemoStatus
  *
  * Called after a death or level completion to allow demos to be cleaned up
  */
 static void G_CheckDemoStatus (void)
 {
+    if (G_IsSimulationOnly())
+    {
+        G_CheckSimulationStatus();
+        return;
+    }
+
     uint32_t realtics = I_EndClock();
-    uint32_t resultfps = TICRATE * 1000L * _g_gametic / realtics;
-    I_Error ("Timed %u gametics in %lu realtics = %lu.%.3lu frames per second",
-             (uint16_t) _g_gametic, realtics,
-             resultfps / 1000, resultfps % 1000);
+    uint32_t resultfps = G_CalculateFps(_g_gametic, realtics);
+
+#if defined FRAME_TIMING
+    D_PrintFrameTimes();
+#endif
+
+#if defined INSTRUMENTED && !defined FLAT_WALL && !defined TEXTURE_ATLAS
+    R_PrintColumnCacheStats();
+#endif
+#if defined INSTRUMENTED && !defined HAVE_MMAP
+    W_PrintLumpCacheStats();
+#endif
+#if defined INSTRUMENTED
+    P_PrintThingPoolStats();
+    R_PrintBspStats();
+#endif
+
+    if (_s_timedemoruns == 1)
+        I_Error ("Timed %u gametics in %lu realtics = %lu.%.3lu frames per second",
+                 (uint16_t) _g_gametic, (unsigned long) realtics,
+                 (unsigned long) (resultfps / 1000), (unsigned long) (resultfps % 1000));
+
+    _s_timedemorun++;
+    printf("Run %d (%s): timed %u gametics in %lu realtics = %lu.%.3lu frames per second\n",
+           _s_timedemorun, _s_timedemorun == 1 ? "cold" : "warm",
+           (uint16_t) _g_gametic, (unsigned long) realtics,
+           (unsigned long) (resultfps / 1000), (unsigned long) (resultfps % 1000));
+
+    if (_s_timedemorun == 1)
+    {
+        _s_coldfps    = resultfps;
+        _s_warmminfps = UINT32_MAX;
+        _s_warmmaxfps = 0;
+    }
+    else
+    {
+        _s_warmgametics += (uint16_t) _g_gametic;
+        _s_warmrealtics += realtics;
+        if (resultfps < _s_warmminfps)
+            _s_warmminfps = resultfps;
+        if (resultfps > _s_warmmaxfps)
+            _s_warmmaxfps = resultfps;
+    }
+
+    if (_s_timedemorun < _s_timedemoruns)
+    {
+        // Replay the demo from the start, the caller continues with its first ticcmd
+        _g_gametic = 0;
+        G_DoPlayDemo();
+        G_ReadDemoTiccmd();
+        return;
+    }
+
+    uint32_t warmfps = G_CalculateFps(_s_warmgametics, _s_warmrealtics);
+    I_Error ("Cold %lu.%.3lu fps, warm %lu.%.3lu fps (min %lu.%.3lu, max %lu.%.3lu) over %d warm runs",
+             (unsigned long) (_s_coldfps / 1000), (unsigned long) (_s_coldfps % 1000),
+             (unsigned long) (warmfps / 1000), (unsigned long) (warmfps % 1000),
+             (unsigned long) (_s_warmminfps / 1000), (unsigned long) (_s_warmminfps % 1000),
+             (unsigned long) (_s_warmmaxfps / 1000), (unsigned long) (_s_warmmaxfps % 1000),
+             _s_timedemoruns - 1);
 }
 
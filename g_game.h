@@ -48,6 +48,9 @@ void G_Ticker(void);
 void G_ReloadDefaults(void);     // killough 3/1/98: loads game defaults
 void G_PlayerReborn(void);
 void G_BuildTiccmd (void);
+void G_SetTimedemoRuns(int16_t runs);
+void G_SetSimulateTics(uint32_t tics);
+boolean G_IsSimulationOnly(void);
 
 boolean G_IsGameticEqualToBasetic(void);
 
@@ -94,6 +94,11 @@ extern divline_t _g_trace;
 
 extern const seg_t    __far* _g_segs;
 
+#if defined VERTEX_ANGLE_CACHE
+extern const uint16_t __far* _g_segvertexnums;
+extern int16_t _g_numvertexes;
+#endif
+
 extern int16_t      _g_numsectors;
 extern sector_t __far* _g_sectors;
 
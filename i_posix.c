@@ -0,0 +1,342 @@
+/*-----------------------------------------------------------------------------
+ *
+ *
+ *  Copyright (C) 2023-2024 Frenkel Smeijers
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Code specific to POSIX hosts, headless for benchmarking
+ *
+ *-----------------------------------------------------------------------------*/
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#if defined THREADED_COLUMNS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "compiler.h"
+
+#include "d_main.h"
+#include "g_game.h"
+#include "i_system.h"
+#include "m_hash.h"
+#include "m_random.h"
+#include "r_defs.h"
+#include "v_video.h"
+#include "w_wad.h"
+
+#include "globdata.h"
+
+
+// Size of the zone in kB, can be overridden with the command line argument zone
+#if !defined ZONE_SIZE
+#define ZONE_SIZE 1024
+#endif
+
+// The zone uses 24 bits for the size of a block
+#define ZONE_SIZE_MAX (16 * 1024L - 1)
+
+
+static uint8_t _s_statusbar[SCREENWIDTH * ST_HEIGHT];
+
+static uint32_t zonesize = ZONE_SIZE;
+
+
+#if defined THREADED_COLUMNS
+//
+// Worker pool
+// The threads are started once and wait for a job between frames.
+// Every thread, the main thread included, runs the job for its own part.
+//
+
+// A part is at least one column of the view window
+#define MAXTHREADS VIEWWINDOWWIDTH
+
+// 0 means one thread per processor, can be overridden with the command line argument threads
+static int16_t numthreads;
+
+static pthread_mutex_t jobmutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  jobstart = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  jobdone  = PTHREAD_COND_INITIALIZER;
+
+static void (*job)(int16_t part, int16_t parts);
+static uint32_t jobgeneration;
+static int16_t  jobsrunning;
+
+
+static void* I_Worker(void* arg)
+{
+	const int16_t part = (intptr_t)arg;
+	uint32_t generation = 0;
+
+	pthread_mutex_lock(&jobmutex);
+	while (true)
+	{
+		while (jobgeneration == generation)
+			pthread_cond_wait(&jobstart, &jobmutex);
+
+		generation = jobgeneration;
+		pthread_mutex_unlock(&jobmutex);
+
+		job(part, numthreads);
+
+		pthread_mutex_lock(&jobmutex);
+		if (--jobsrunning == 0)
+			pthread_cond_signal(&jobdone);
+	}
+
+	return NULL;
+}
+
+
+static void I_InitThreads(void)
+{
+	if (numthreads <= 0)
+		numthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (numthreads < 1)
+		numthreads = 1;
+	else if (numthreads > MAXTHREADS)
+		numthreads = MAXTHREADS;
+
+	for (int16_t i = 1; i < numthreads; i++)
+	{
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, I_Worker, (void*)(intptr_t)i))
+			I_Error("I_InitThreads: Can't start thread %i", i);
+	}
+
+	printf("Drawing columns with %i threads\n", numthreads);
+}
+
+
+//
+// I_RunParallel
+// Runs f(part, parts) for every part on its own thread
+// and returns when all parts are done.
+//
+void I_RunParallel(void (*f)(int16_t part, int16_t parts))
+{
+	if (numthreads == 1)
+	{
+		f(0, 1);
+		return;
+	}
+
+	pthread_mutex_lock(&jobmutex);
+	job = f;
+	jobsrunning = numthreads - 1;
+	jobgeneration++;
+	pthread_cond_broadcast(&jobstart);
+	pthread_mutex_unlock(&jobmutex);
+
+	f(0, numthreads);
+
+	pthread_mutex_lock(&jobmutex);
+	while (jobsrunning)
+		pthread_cond_wait(&jobdone, &jobmutex);
+	pthread_mutex_unlock(&jobmutex);
+}
+#endif
+
+
+void I_InitGraphics(void)
+{
+#if defined THREADED_COLUMNS
+	I_InitThreads();
+#endif
+}
+
+
+void I_SetPalette(int8_t pal)
+{
+
+}
+
+
+void R_InitColormaps(void)
+{
+	fullcolormap = W_GetLumpByNum(W_GetNumForName("COLORMAP")); // Never freed
+}
+
+
+void V_DrawRaw(int16_t num, uint16_t offset)
+{
+	const uint8_t *lump = W_TryGetLumpByNum(num);
+
+	if (lump != NULL)
+	{
+		uint16_t lumpLength = W_LumpLength(num);
+		memcpy(&_s_statusbar[offset - (SCREENHEIGHT - ST_HEIGHT) * SCREENWIDTH], lump, lumpLength);
+		Z_ChangeTagToCache(lump);
+	}
+	else
+		W_ReadLumpByNum(num, &_s_statusbar[offset - (SCREENHEIGHT - ST_HEIGHT) * SCREENWIDTH]);
+}
+
+
+void ST_Drawer(void)
+{
+	if (ST_NeedUpdate())
+		ST_doRefresh();
+}
+
+
+void V_DrawPatchNotScaled(int16_t x, int16_t y, const patch_t __far* patch)
+{
+	y -= patch->topoffset;
+	x -= patch->leftoffset;
+
+	byte *desttop = _s_statusbar + (y * SCREENWIDTH) + x - (SCREENHEIGHT - ST_HEIGHT) * SCREENWIDTH;
+
+	int16_t width = patch->width;
+
+	for (int16_t col = 0; col < width; col++, desttop++)
+	{
+		const column_t *column = (const column_t*)((const byte*)patch + (uint16_t)patch->columnofs[col]);
+
+		// step through the posts in a column
+		while (column->topdelta != 0xff)
+		{
+			const byte *source = (const byte*)column + 3;
+			byte *dest = desttop + (column->topdelta * SCREENWIDTH);
+
+			uint16_t count = column->length;
+
+			while (count--)
+			{
+				*dest = *source++;
+				dest += SCREENWIDTH;
+			}
+
+			column = (const column_t*)((const byte*)column + column->length + 4);
+		}
+	}
+}
+
+
+segment_t I_ZoneBase(uint32_t *size)
+{
+	if (zonesize == 0 || zonesize > ZONE_SIZE_MAX)
+		I_Error("I_ZoneBase: zone size must be between 1 and %ld kB", ZONE_SIZE_MAX);
+
+	uint32_t bytes = zonesize * 1024;
+
+	// segment_t and the zone's user pointers are 32 bits,
+	// so on 64-bit hosts the zone has to be mapped below 4 GB
+#if defined MAP_32BIT
+	uint8_t *ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+#else
+	uint8_t *ptr = mmap((void *)0x10000000, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#endif
+	if (ptr == MAP_FAILED)
+		I_Error("I_ZoneBase: failed to map %lu bytes for zone", (unsigned long)bytes);
+
+#if defined __LP64__
+	if ((uintptr_t)ptr + bytes > UINT32_MAX || (uintptr_t)_s_statusbar > UINT32_MAX)
+		I_Error("I_ZoneBase: memory is above 4 GB, link with -no-pie");
+#endif
+
+	// mmap returns page aligned memory
+	*size = bytes;
+	printf("Standard: %lu bytes allocated for zone\n", (unsigned long)*size);
+	return D_FP_SEG(ptr);
+}
+
+
+segment_t I_ZoneAdditional(uint32_t *size)
+{
+	*size = 0;
+	return 0;
+}
+
+
+static struct timespec starttime;
+
+
+void I_StartClock(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &starttime);
+}
+
+
+uint32_t I_EndClock(void)
+{
+	struct timespec endtime;
+	clock_gettime(CLOCK_MONOTONIC, &endtime);
+
+	int64_t nanoseconds = (endtime.tv_sec - starttime.tv_sec) * 1000000000LL + (endtime.tv_nsec - starttime.tv_nsec);
+	return (nanoseconds * TICRATE) / 1000000000LL;
+}
+
+
+#if defined FRAME_TIMING
+uint32_t I_GetMicroseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+#endif
+
+
+void I_Error2(const char *error, ...)
+{
+	va_list argptr;
+
+	va_start(argptr, error);
+	vprintf(error, argptr);
+	va_end(argptr);
+	printf("\n");
+	exit(1);
+}
+
+
+int main(int argc, const char * const * argv)
+{
+	for (int16_t i = 1; i < argc - 1; i++)
+	{
+		if (!strcasecmp("zone", argv[i]))
+			zonesize = atol(argv[++i]);
+		else if (!strcasecmp("runs", argv[i]))
+			G_SetTimedemoRuns(atoi(argv[++i]));
+		else if (!strcasecmp("simulate", argv[i]))
+			G_SetSimulateTics(strtoul(argv[++i], NULL, 10));
+#if defined THREADED_COLUMNS
+		else if (!strcasecmp("threads", argv[i]))
+			numthreads = atoi(argv[++i]);
+#endif
+#if defined TIC_HASH
+		else if (!strcasecmp("tichash", argv[i]))
+			M_OpenTicHash(argv[++i], false);
+		else if (!strcasecmp("tichashcompare", argv[i]))
+			M_OpenTicHash(argv[++i], true);
+#endif
+	}
+
+	D_DoomMain();
+	return 0;
+}
@@ -0,0 +1,450 @@
+/*-----------------------------------------------------------------------------
+ *
+ *
+ *  Copyright (C) 2023-2024 Frenkel Smeijers
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      The view window of POSIX hosts, its column drawers
+ *      and the copy to the frame buffer.
+ *      It doesn't need the rest of the game, so colbench can use it too.
+ *
+ *-----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined COLUMN_MAJOR
+#if defined __SSE2__
+#include <emmintrin.h>
+#elif defined __ARM_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+#include "compiler.h"
+
+#include "i_system.h"
+#include "r_main.h"
+
+
+extern const int16_t CENTERY;
+
+#if defined COLUMN_MAJOR
+// Every column of the view window is contiguous,
+// I_FinishUpdate transposes it to rows
+#define VIEWWINDOW(x,y)	((x) * VIEWWINDOWHEIGHT + (y))
+#define NEXTROW			1
+#else
+#define VIEWWINDOW(x,y)	((y) * VIEWWINDOWWIDTH + (x))
+#define NEXTROW			VIEWWINDOWWIDTH
+#endif
+
+static uint8_t _s_viewwindow[VIEWWINDOWWIDTH * VIEWWINDOWHEIGHT];
+
+// There is no display, I_FinishUpdate copies to plain memory instead
+static uint8_t _s_framebuffer[VIEWWINDOWWIDTH * VIEWWINDOWHEIGHT];
+
+
+#if defined COLUMN_MAJOR
+#define BLOCKSIZE 8
+
+//
+// I_TransposeBlock
+// Copies the 8 by 8 pixels of the columns starting at src
+// to the rows starting at dest.
+//
+#if defined __SSE2__
+static void I_TransposeBlock(uint8_t *dest, const uint8_t *src)
+{
+	const __m128i c0 = _mm_loadl_epi64((const __m128i*)&src[0 * VIEWWINDOWHEIGHT]);
+	const __m128i c1 = _mm_loadl_epi64((const __m128i*)&src[1 * VIEWWINDOWHEIGHT]);
+	const __m128i c2 = _mm_loadl_epi64((const __m128i*)&src[2 * VIEWWINDOWHEIGHT]);
+	const __m128i c3 = _mm_loadl_epi64((const __m128i*)&src[3 * VIEWWINDOWHEIGHT]);
+	const __m128i c4 = _mm_loadl_epi64((const __m128i*)&src[4 * VIEWWINDOWHEIGHT]);
+	const __m128i c5 = _mm_loadl_epi64((const __m128i*)&src[5 * VIEWWINDOWHEIGHT]);
+	const __m128i c6 = _mm_loadl_epi64((const __m128i*)&src[6 * VIEWWINDOWHEIGHT]);
+	const __m128i c7 = _mm_loadl_epi64((const __m128i*)&src[7 * VIEWWINDOWHEIGHT]);
+
+	// pairs of columns, a row every 2 bytes
+	const __m128i c01 = _mm_unpacklo_epi8(c0, c1);
+	const __m128i c23 = _mm_unpacklo_epi8(c2, c3);
+	const __m128i c45 = _mm_unpacklo_epi8(c4, c5);
+	const __m128i c67 = _mm_unpacklo_epi8(c6, c7);
+
+	// quads of columns, a row every 4 bytes
+	const __m128i c0123lo = _mm_unpacklo_epi16(c01, c23);
+	const __m128i c0123hi = _mm_unpackhi_epi16(c01, c23);
+	const __m128i c4567lo = _mm_unpacklo_epi16(c45, c67);
+	const __m128i c4567hi = _mm_unpackhi_epi16(c45, c67);
+
+	// two rows each
+	const __m128i r01 = _mm_unpacklo_epi32(c0123lo, c4567lo);
+	const __m128i r23 = _mm_unpackhi_epi32(c0123lo, c4567lo);
+	const __m128i r45 = _mm_unpacklo_epi32(c0123hi, c4567hi);
+	const __m128i r67 = _mm_unpackhi_epi32(c0123hi, c4567hi);
+
+	_mm_storel_epi64((__m128i*)&dest[0 * VIEWWINDOWWIDTH], r01);
+	_mm_storel_epi64((__m128i*)&dest[1 * VIEWWINDOWWIDTH], _mm_unpackhi_epi64(r01, r01));
+	_mm_storel_epi64((__m128i*)&dest[2 * VIEWWINDOWWIDTH], r23);
+	_mm_storel_epi64((__m128i*)&dest[3 * VIEWWINDOWWIDTH], _mm_unpackhi_epi64(r23, r23));
+	_mm_storel_epi64((__m128i*)&dest[4 * VIEWWINDOWWIDTH], r45);
+	_mm_storel_epi64((__m128i*)&dest[5 * VIEWWINDOWWIDTH], _mm_unpackhi_epi64(r45, r45));
+	_mm_storel_epi64((__m128i*)&dest[6 * VIEWWINDOWWIDTH], r67);
+	_mm_storel_epi64((__m128i*)&dest[7 * VIEWWINDOWWIDTH], _mm_unpackhi_epi64(r67, r67));
+}
+#elif defined __ARM_NEON
+static void I_TransposeBlock(uint8_t *dest, const uint8_t *src)
+{
+	// pairs of columns
+	const uint8x8x2_t c01 = vtrn_u8(vld1_u8(&src[0 * VIEWWINDOWHEIGHT]), vld1_u8(&src[1 * VIEWWINDOWHEIGHT]));
+	const uint8x8x2_t c23 = vtrn_u8(vld1_u8(&src[2 * VIEWWINDOWHEIGHT]), vld1_u8(&src[3 * VIEWWINDOWHEIGHT]));
+	const uint8x8x2_t c45 = vtrn_u8(vld1_u8(&src[4 * VIEWWINDOWHEIGHT]), vld1_u8(&src[5 * VIEWWINDOWHEIGHT]));
+	const uint8x8x2_t c67 = vtrn_u8(vld1_u8(&src[6 * VIEWWINDOWHEIGHT]), vld1_u8(&src[7 * VIEWWINDOWHEIGHT]));
+
+	// quads of columns, even and odd rows
+	const uint16x4x2_t c0123even = vtrn_u16(vreinterpret_u16_u8(c01.val[0]), vreinterpret_u16_u8(c23.val[0]));
+	const uint16x4x2_t c0123odd  = vtrn_u16(vreinterpret_u16_u8(c01.val[1]), vreinterpret_u16_u8(c23.val[1]));
+	const uint16x4x2_t c4567even = vtrn_u16(vreinterpret_u16_u8(c45.val[0]), vreinterpret_u16_u8(c67.val[0]));
+	const uint16x4x2_t c4567odd  = vtrn_u16(vreinterpret_u16_u8(c45.val[1]), vreinterpret_u16_u8(c67.val[1]));
+
+	// rows y and y + 4
+	const uint32x2x2_t r04 = vtrn_u32(vreinterpret_u32_u16(c0123even.val[0]), vreinterpret_u32_u16(c4567even.val[0]));
+	const uint32x2x2_t r15 = vtrn_u32(vreinterpret_u32_u16(c0123odd.val[0]),  vreinterpret_u32_u16(c4567odd.val[0]));
+	const uint32x2x2_t r26 = vtrn_u32(vreinterpret_u32_u16(c0123even.val[1]), vreinterpret_u32_u16(c4567even.val[1]));
+	const uint32x2x2_t r37 = vtrn_u32(vreinterpret_u32_u16(c0123odd.val[1]),  vreinterpret_u32_u16(c4567odd.val[1]));
+
+	vst1_u8(&dest[0 * VIEWWINDOWWIDTH], vreinterpret_u8_u32(r04.val[0]));
+	vst1_u8(&dest[1 * VIEWWINDOWWIDTH], vreinterpret_u8_u32(r15.val[0]));
+	vst1_u8(&dest[2 * VIEWWINDOWWIDTH], vreinterpret_u8_u32(r26.val[0]));
+	vst1_u8(&dest[3 * VIEWWINDOWWIDTH], vreinterpret_u8_u32(r37.val[0]));
+	vst1_u8(&dest[4 * VIEWWINDOWWIDTH], vreinterpret_u8_u32(r04.val[1]));
+	vst1_u8(&dest[5 * VIEWWINDOWWIDTH], vreinterpret_u8_u32(r15.val[1]));
+	vst1_u8(&dest[6 * VIEWWINDOWWIDTH], vreinterpret_u8_u32(r26.val[1]));
+	vst1_u8(&dest[7 * VIEWWINDOWWIDTH], vreinterpret_u8_u32(r37.val[1]));
+}
+#else
+static void I_TransposeBlock(uint8_t *dest, const uint8_t *src)
+{
+	for (int16_t y = 0; y < BLOCKSIZE; y++)
+		for (int16_t x = 0; x < BLOCKSIZE; x++)
+			dest[y * VIEWWINDOWWIDTH + x] = src[x * VIEWWINDOWHEIGHT + y];
+}
+#endif
+
+
+static void I_TransposeViewWindow(uint8_t *dest)
+{
+	const int16_t blockwidth  = VIEWWINDOWWIDTH  - VIEWWINDOWWIDTH  % BLOCKSIZE;
+	const int16_t blockheight = VIEWWINDOWHEIGHT - VIEWWINDOWHEIGHT % BLOCKSIZE;
+
+	for (int16_t y = 0; y < blockheight; y += BLOCKSIZE)
+		for (int16_t x = 0; x < blockwidth; x += BLOCKSIZE)
+			I_TransposeBlock(&dest[y * VIEWWINDOWWIDTH + x], &_s_viewwindow[VIEWWINDOW(x, y)]);
+
+	// the columns and rows that don't fill a block
+	for (int16_t y = 0; y < VIEWWINDOWHEIGHT; y++)
+		for (int16_t x = y < blockheight ? blockwidth : 0; x < VIEWWINDOWWIDTH; x++)
+			dest[y * VIEWWINDOWWIDTH + x] = _s_viewwindow[VIEWWINDOW(x, y)];
+}
+#endif
+
+
+void I_FinishUpdate(void)
+{
+#if defined COLUMN_MAJOR
+	I_TransposeViewWindow(_s_framebuffer);
+#else
+	memcpy(_s_framebuffer, _s_viewwindow, VIEWWINDOWWIDTH * VIEWWINDOWHEIGHT);
+#endif
+}
+
+
+#if defined TIC_HASH
+const uint8_t* I_GetViewWindow(void)
+{
+#if defined COLUMN_MAJOR
+	// the hashes are of the rows, whatever the layout
+	static uint8_t rows[VIEWWINDOWWIDTH * VIEWWINDOWHEIGHT];
+	I_TransposeViewWindow(rows);
+	return rows;
+#else
+	return _s_viewwindow;
+#endif
+}
+#endif
+
+
+#define COLEXTRABITS (8 - 1)
+#define COLBITS (8 + 1)
+
+static uint8_t *R_DrawRun(uint8_t *dest, uint8_t color, int16_t count)
+{
+#if defined COLUMN_MAJOR
+	memset(dest, color, count);
+	return dest + count;
+#else
+	while (count--)
+	{
+		*dest = color;
+		dest += NEXTROW;
+	}
+	return dest;
+#endif
+}
+
+
+//
+// R_DrawColumnMagnified
+// For columns with less than one texel per pixel.
+// Every texel covers a run of pixels, so it's looked up only once per run.
+// frac steps exactly like in R_DrawColumn, so the pixels are the same.
+//
+
+// Below this scale the runs are long enough to beat R_DrawColumn,
+// with shorter runs looking up every pixel is faster
+#if defined COLUMN_MAJOR
+#define MAGNIFIED_ISCALE (FRACUNIT / 8)
+#else
+#define MAGNIFIED_ISCALE (FRACUNIT / 16)
+#endif
+
+static void R_DrawColumnMagnified(const draw_column_vars_t *dcvars, int16_t count)
+{
+	const uint8_t *source = dcvars->source;
+
+	const uint8_t *nearcolormap = dcvars->colormap;
+
+	uint8_t *dest = &_s_viewwindow[VIEWWINDOW(dcvars->x, dcvars->yl)];
+
+	const uint16_t fracstep = (dcvars->iscale >> COLEXTRABITS);
+	uint16_t frac = (dcvars->texturemid + (dcvars->yl - CENTERY) * dcvars->iscale) >> COLEXTRABITS;
+
+	if (fracstep == 0)
+	{
+		R_DrawRun(dest, nearcolormap[source[frac>>COLBITS]], count);
+		return;
+	}
+
+	// A texel is texelsteps steps of frac long, or one more
+	// when frac starts less than texelrest into the texel.
+	// Only the first texel can start further in than one step.
+	const uint16_t texelsteps = (1 << COLBITS) / fracstep;
+	const uint16_t texelrest  = (1 << COLBITS) % fracstep;
+
+	uint16_t offset = frac & ((1 << COLBITS) - 1);
+	int16_t run = ((1 << COLBITS) - offset + fracstep - 1) / fracstep;
+
+	while (true)
+	{
+		const uint8_t color = nearcolormap[source[frac>>COLBITS]];
+
+		if (run >= count)
+		{
+			R_DrawRun(dest, color, count);
+			return;
+		}
+
+		dest   = R_DrawRun(dest, color, run);
+		count -= run;
+		frac  += run * fracstep;
+
+		offset = frac & ((1 << COLBITS) - 1);
+		run = texelsteps + (offset < texelrest);
+	}
+}
+
+
+void R_DrawColumn(const draw_column_vars_t *dcvars)
+{
+	const int16_t count = (dcvars->yh - dcvars->yl) + 1;
+
+	// Zero length, column does not exceed a pixel.
+	if (count <= 0)
+		return;
+
+	if (dcvars->iscale < MAGNIFIED_ISCALE)
+	{
+		R_DrawColumnMagnified(dcvars, count);
+		return;
+	}
+
+	const uint8_t *source = dcvars->source;
+
+	const uint8_t *nearcolormap = dcvars->colormap;
+
+	uint8_t *dest = &_s_viewwindow[VIEWWINDOW(dcvars->x, dcvars->yl)];
+
+	const uint16_t fracstep = (dcvars->iscale >> COLEXTRABITS);
+	uint16_t frac = (dcvars->texturemid + (dcvars->yl - CENTERY) * dcvars->iscale) >> COLEXTRABITS;
+
+	int16_t l = count >> 4;
+
+	while (l--)
+	{
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		*dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+	}
+
+	switch (count & 15)
+	{
+		case 15: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case 14: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case 13: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case 12: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case 11: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case 10: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case  9: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case  8: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case  7: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case  6: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case  5: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case  4: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case  3: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case  2: *dest = nearcolormap[source[frac>>COLBITS]]; dest += NEXTROW; frac += fracstep;
+		case  1: *dest = nearcolormap[source[frac>>COLBITS]];
+	}
+}
+
+
+void R_DrawColumnFlat(int16_t texture, const draw_column_vars_t *dcvars)
+{
+	int16_t count = (dcvars->yh - dcvars->yl) + 1;
+
+	if (count <= 0)
+		return;
+
+	const uint8_t color1 = texture;
+	const uint8_t color2 = (color1 << 4 | color1 >> 4);
+	const uint8_t colort = color1 + color2;
+	      uint8_t color  = (dcvars->yl & 1) ? color1 : color2;
+
+	uint8_t *dest = &_s_viewwindow[VIEWWINDOW(dcvars->x, dcvars->yl)];
+
+	while (count--)
+	{
+		*dest = color;
+		dest += NEXTROW;
+		color = colort - color;
+	}
+}
+
+
+#define FUZZOFF (NEXTROW)
+#define FUZZTABLE 50
+
+static const int8_t fuzzoffset[FUZZTABLE] =
+{
+	FUZZOFF,-FUZZOFF,FUZZOFF,-FUZZOFF,FUZZOFF,FUZZOFF,-FUZZOFF,
+	FUZZOFF,FUZZOFF,-FUZZOFF,FUZZOFF,FUZZOFF,FUZZOFF,-FUZZOFF,
+	FUZZOFF,FUZZOFF,FUZZOFF,-FUZZOFF,-FUZZOFF,-FUZZOFF,-FUZZOFF,
+	FUZZOFF,-FUZZOFF,-FUZZOFF,FUZZOFF,FUZZOFF,FUZZOFF,FUZZOFF,-FUZZOFF,
+	FUZZOFF,-FUZZOFF,FUZZOFF,FUZZOFF,-FUZZOFF,-FUZZOFF,FUZZOFF,
+	FUZZOFF,-FUZZOFF,-FUZZOFF,-FUZZOFF,-FUZZOFF,FUZZOFF,FUZZOFF,
+	FUZZOFF,FUZZOFF,-FUZZOFF,FUZZOFF,FUZZOFF,-FUZZOFF,FUZZOFF
+};
+
+
+// The rows R_DrawFuzzColumn draws, it reads the rows above and below them
+static int16_t R_GetFuzzColumnRows(const draw_column_vars_t *dcvars, int16_t *yl)
+{
+	int16_t dc_yl = dcvars->yl;
+	int16_t dc_yh = dcvars->yh;
+
+	// Adjust borders. Low...
+	if (dc_yl <= 0)
+		dc_yl = 1;
+
+	// .. and high.
+	if (dc_yh >= VIEWWINDOWHEIGHT - 1)
+		dc_yh = VIEWWINDOWHEIGHT - 2;
+
+	*yl = dc_yl;
+	return (dc_yh - dc_yl) + 1;
+}
+
+
+static int16_t R_DrawFuzzColumnFrom(const draw_column_vars_t *dcvars, int16_t fuzzpos)
+{
+	int16_t dc_yl;
+	int16_t count = R_GetFuzzColumnRows(dcvars, &dc_yl);
+
+	// Zero length, column does not exceed a pixel.
+	if (count <= 0)
+		return fuzzpos;
+
+	const uint8_t *nearcolormap = &fullcolormap[6 * 256];
+
+	uint8_t *dest = &_s_viewwindow[VIEWWINDOW(dcvars->x, dc_yl)];
+
+	do
+	{
+		*dest = nearcolormap[dest[fuzzoffset[fuzzpos]]];
+		dest += NEXTROW;
+
+		fuzzpos++;
+		if (fuzzpos >= FUZZTABLE)
+			fuzzpos = 0;
+
+	} while(--count);
+
+	return fuzzpos;
+}
+
+
+void R_DrawFuzzColumn(const draw_column_vars_t *dcvars)
+{
+	static int16_t fuzzpos = 0;
+
+	fuzzpos = R_DrawFuzzColumnFrom(dcvars, fuzzpos);
+}
+
+
+#if defined THREADED_COLUMNS
+// Draws a fuzz column starting at the given position in the fuzz table
+void R_DrawFuzzColumnAt(const draw_column_vars_t *dcvars, int16_t fuzzpos)
+{
+	R_DrawFuzzColumnFrom(dcvars, fuzzpos);
+}
+
+
+// The position in the fuzz table after drawing the column
+int16_t R_SkipFuzzColumn(const draw_column_vars_t *dcvars, int16_t fuzzpos)
+{
+	int16_t dc_yl;
+	int16_t count = R_GetFuzzColumnRows(dcvars, &dc_yl);
+
+	return count <= 0 ? fuzzpos : (fuzzpos + count) % FUZZTABLE;
+}
+#endif
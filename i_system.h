@@ -57,12 +57,27 @@ void I_InitGraphics(void);
 void I_SetPalette(int8_t pal);
 void I_FinishUpdate(void);
 
+#if defined TIC_HASH
+// The view window as drawn by R_DrawColumn, only needed for TIC_HASH
+const uint8_t* I_GetViewWindow(void);
+#endif
+
 
+// The colormaps hold device values, R_InitColormaps composes any further
+// mapping of the backend into them, like the inversion for LCDs.
+// So the column drawers write final device values and I_FinishUpdate
+// only copies the view window.
 void R_InitColormaps(void);
 void R_DrawColumn(const draw_column_vars_t *dcvars);
 void R_DrawColumnFlat(int16_t texture, const draw_column_vars_t *dcvars);
 void R_DrawFuzzColumn(const draw_column_vars_t *dcvars);
 
+#if defined THREADED_COLUMNS
+void R_DrawFuzzColumnAt(const draw_column_vars_t *dcvars, int16_t fuzzpos);
+int16_t R_SkipFuzzColumn(const draw_column_vars_t *dcvars, int16_t fuzzpos);
+void I_RunParallel(void (*f)(int16_t part, int16_t parts));
+#endif
+
 
 void V_DrawRaw(int16_t num, uint16_t offset);
 void ST_Drawer(void);
@@ -76,4 +91,9 @@ segment_t I_ZoneAdditional(uint32_t *size);
 void I_StartClock(void);
 uint32_t I_EndClock(void);
 
+#if defined FRAME_TIMING
+// Free running clock in microseconds, only needed for FRAME_TIMING
+uint32_t I_GetMicroseconds(void);
+#endif
+
 #endif
@@ -0,0 +1,265 @@
+/*-----------------------------------------------------------------------------
+ *
+ *
+ *  Copyright (C) 2024 Frenkel Smeijers
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Per-tic hashes of the game state and the view window,
+ *      to check that a change keeps the demo in sync.
+ *
+ *      The file starts with TICHASH_MAGIC, followed by one record per tic
+ *      of NUMHASHES little-endian 32-bit FNV-1a hashes.
+ *      Pointers are never hashed, so the hashes don't depend on where
+ *      the zone is, but they do depend on the endianness of the host.
+ *
+ *-----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "d_player.h"
+#include "i_system.h"
+#include "info.h"
+#include "m_hash.h"
+#include "m_random.h"
+#include "p_mobj.h"
+#include "p_tick.h"
+
+#include "globdata.h"
+
+
+#define TICHASH_MAGIC "TICHASH1"
+
+// Exit status when the hashes don't match.
+// I_Error exits with 1, also at the end of every timedemo.
+#define TICHASH_MISMATCH 2
+
+enum
+{
+	HASH_MOBJS,
+	HASH_PLAYER,
+	HASH_RANDOM,
+	HASH_VIEWWINDOW,
+	NUMHASHES
+};
+
+static const char* const hashnames[NUMHASHES] =
+{
+	"mobjs", "player", "P_Random index", "view window"
+};
+
+#define FNV_OFFSET_BASIS 0x811c9dc5UL
+#define FNV_PRIME        0x01000193UL
+
+static FILE* tichashfile;
+static boolean tichashcompare;
+static uint32_t tichashtic;
+
+static uint32_t mobjshash;
+
+
+static uint32_t M_HashBytes(uint32_t hash, const void __far* data, size_t size)
+{
+	const uint8_t __far* p = data;
+	while (size--)
+	{
+		hash ^= *p++;
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+
+static uint32_t M_HashInt32(uint32_t hash, int32_t value)
+{
+	uint8_t bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+	return M_HashBytes(hash, bytes, sizeof(bytes));
+}
+
+
+static void M_HashMobj(const thinker_t __far* thinker)
+{
+	if (!P_IsThinkingMobj(thinker))
+		return;
+
+	const mobj_t __far* mobj = (const mobj_t __far*)thinker;
+
+	uint32_t hash = mobjshash;
+	hash = M_HashInt32(hash, mobj->type);
+	hash = M_HashInt32(hash, mobj->x);
+	hash = M_HashInt32(hash, mobj->y);
+	hash = M_HashInt32(hash, mobj->z);
+	hash = M_HashInt32(hash, mobj->momx);
+	hash = M_HashInt32(hash, mobj->momy);
+	hash = M_HashInt32(hash, mobj->momz);
+	hash = M_HashInt32(hash, mobj->angle);
+	hash = M_HashInt32(hash, mobj->health);
+	hash = M_HashInt32(hash, mobj->state - states);
+	hash = M_HashInt32(hash, mobj->tics);
+	hash = M_HashInt32(hash, mobj->flags);
+	mobjshash = hash;
+}
+
+
+static uint32_t M_HashPlayer(const player_t* player)
+{
+	uint32_t hash = FNV_OFFSET_BASIS;
+	hash = M_HashInt32(hash, player->playerstate);
+	hash = M_HashInt32(hash, player->viewz);
+	hash = M_HashInt32(hash, player->viewheight);
+	hash = M_HashInt32(hash, player->deltaviewheight);
+	hash = M_HashInt32(hash, player->bob);
+	hash = M_HashInt32(hash, player->momx);
+	hash = M_HashInt32(hash, player->momy);
+	hash = M_HashInt32(hash, player->health);
+	hash = M_HashInt32(hash, player->armorpoints);
+	hash = M_HashInt32(hash, player->armortype);
+	hash = M_HashInt32(hash, player->readyweapon);
+	hash = M_HashInt32(hash, player->pendingweapon);
+	hash = M_HashInt32(hash, player->refire);
+	hash = M_HashInt32(hash, player->damagecount);
+	hash = M_HashInt32(hash, player->bonuscount);
+	hash = M_HashInt32(hash, player->extralight);
+
+	for (int8_t i = 0; i < NUMPOWERS; i++)
+		hash = M_HashInt32(hash, player->powers[i]);
+
+	for (int8_t i = 0; i < NUMAMMO; i++)
+		hash = M_HashInt32(hash, player->ammo[i]);
+
+	for (int8_t i = 0; i < NUMPSPRITES; i++)
+	{
+		const pspdef_t* psp = &player->psprites[i];
+		hash = M_HashInt32(hash, psp->state ? psp->state - states : -1);
+		hash = M_HashInt32(hash, psp->tics);
+		hash = M_HashInt32(hash, psp->sx);
+		hash = M_HashInt32(hash, psp->sy);
+	}
+
+	return hash;
+}
+
+
+static void M_CloseTicHash(void)
+{
+	if (!tichashfile)
+		return;
+
+	// A run that ends early doesn't match
+	const boolean reftoolong = tichashcompare && fgetc(tichashfile) != EOF;
+
+	fclose(tichashfile);
+	tichashfile = NULL;
+
+	if (reftoolong)
+	{
+		// This runs at exit, so it can't call exit again
+		printf("Tic hashes of %lu tics match, but the reference has more tics than this run\n", (unsigned long)tichashtic);
+		fflush(stdout);
+		_Exit(TICHASH_MISMATCH);
+	}
+	else if (tichashcompare)
+		printf("Tic hashes of %lu tics match\n", (unsigned long)tichashtic);
+	else
+		printf("Tic hashes of %lu tics written\n", (unsigned long)tichashtic);
+}
+
+
+void M_OpenTicHash(const char* filename, boolean compare)
+{
+	char magic[sizeof(TICHASH_MAGIC) - 1];
+
+	tichashcompare = compare;
+	tichashfile = fopen(filename, compare ? "rb" : "wb");
+	if (!tichashfile)
+		I_Error("M_OpenTicHash: can't open %s", filename);
+
+	if (compare)
+	{
+		if (fread(magic, sizeof(magic), 1, tichashfile) != 1 || memcmp(magic, TICHASH_MAGIC, sizeof(magic)))
+			I_Error("M_OpenTicHash: %s is not a tic hash file", filename);
+	}
+	else
+		fwrite(TICHASH_MAGIC, sizeof(magic), 1, tichashfile);
+
+	atexit(M_CloseTicHash);
+}
+
+
+void M_TicHash(void)
+{
+	if (!tichashfile)
+		return;
+
+	uint32_t hashes[NUMHASHES];
+
+	mobjshash = FNV_OFFSET_BASIS;
+	P_IterateThinkers(M_HashMobj);
+	hashes[HASH_MOBJS] = mobjshash;
+
+	hashes[HASH_PLAYER]     = M_HashPlayer(&_g_player);
+	hashes[HASH_RANDOM]     = P_GetRandomIndex();
+	hashes[HASH_VIEWWINDOW] = M_HashBytes(FNV_OFFSET_BASIS, I_GetViewWindow(), VIEWWINDOWWIDTH * VIEWWINDOWHEIGHT);
+
+	uint8_t record[NUMHASHES * 4];
+	if (tichashcompare)
+	{
+		if (fread(record, sizeof(record), 1, tichashfile) != 1)
+		{
+			fclose(tichashfile);
+			tichashfile = NULL;
+			printf("Tic hash file ends at tic %lu, this run has more tics\n", (unsigned long)tichashtic);
+			exit(TICHASH_MISMATCH);
+		}
+
+		char differences[64] = "";
+		for (int8_t i = 0; i < NUMHASHES; i++)
+		{
+			uint32_t expected = record[i * 4] | (uint32_t)record[i * 4 + 1] << 8 | (uint32_t)record[i * 4 + 2] << 16 | (uint32_t)record[i * 4 + 3] << 24;
+			if (hashes[i] != expected)
+			{
+				if (differences[0])
+					strcat(differences, ", ");
+				strcat(differences, hashnames[i]);
+			}
+		}
+
+		if (differences[0])
+		{
+			fclose(tichashfile);
+			tichashfile = NULL;
+			printf("Tic %lu (gametic %d) differs in: %s\n", (unsigned long)tichashtic, _g_gametic, differences);
+			exit(TICHASH_MISMATCH);
+		}
+	}
+	else
+	{
+		for (int8_t i = 0; i < NUMHASHES; i++)
+		{
+			record[i * 4 + 0] = hashes[i];
+			record[i * 4 + 1] = hashes[i] >> 8;
+			record[i * 4 + 2] = hashes[i] >> 16;
+			record[i * 4 + 3] = hashes[i] >> 24;
+		}
+		fwrite(record, sizeof(record), 1, tichashfile);
+	}
+
+	tichashtic++;
+}
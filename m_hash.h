@@ -0,0 +1,38 @@
+/*-----------------------------------------------------------------------------
+ *
+ *
+ *  Copyright (C) 2024 Frenkel Smeijers
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Per-tic hashes of the game state and the view window,
+ *      to check that a change keeps the demo in sync.
+ *
+ *-----------------------------------------------------------------------------*/
+
+#ifndef __M_HASH__
+#define __M_HASH__
+
+#include "doomtype.h"
+
+// Write the hashes to filename, or compare them with the hashes in filename.
+void M_OpenTicHash(const char* filename, boolean compare);
+
+// Hash the current tic, after it has been drawn.
+void M_TicHash(void);
+
+#endif
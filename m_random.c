@@ -91,3 +91,11 @@ void M_ClearRandom (void)
 {
     rndindex = prndindex = 0;
 }
+
+
+#if defined TIC_HASH
+uint8_t P_GetRandomIndex(void)
+{
+    return prndindex;
+}
+#endif
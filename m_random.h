@@ -50,4 +50,9 @@ int16_t P_Random (void);
 // Fix randoms for demos.
 void M_ClearRandom (void);
 
+#if defined TIC_HASH
+// Position of P_Random in the table, to check demo sync.
+uint8_t P_GetRandomIndex(void);
+#endif
+
 #endif
@@ -678,28 +678,88 @@ static think_t P_ThinkerFunctionForType(mobjtype_t type, mobj_t __far* mobj)
     return NULL;
 }
 
+#if defined TIC_HASH
+// Things without a thinker function never change
+boolean P_IsThinkingMobj(const thinker_t __far* thinker)
+{
+    return thinker->function == P_MobjThinker || thinker->function == P_MobjBrainlessThinker;
+}
+#endif
+
+
+//
+// Thing pool
+// The free things of the pool are linked through snext.
+//
+
+#if !defined THINGPOOL_EXTRA
+#define THINGPOOL_EXTRA 0	// extra slots, in percent of the things of the level
+#endif
+
+static mobj_t __far* thingpoolfree;
+
+#if defined INSTRUMENTED
+static int16_t thingsinuse;
+static int16_t thingshighwater;
+static int16_t thingoverflows;
+#endif
+
+
+void P_InitThingPool(int16_t numthings)
+{
+    // Z_CallocLevel allocates less than 64 kB,
+    // the things that don't fit come from the zone
+    const int16_t maxsize = 0xffff / sizeof(mobj_t);
+
+    int32_t size = numthings + (int32_t)numthings * THINGPOOL_EXTRA / 100;
+    if (size > maxsize)
+        size = maxsize;
+
+    _g_thingPool = Z_CallocLevel(size * sizeof(mobj_t));
+    _g_thingPoolSize = size;
+
+    // the last thing of the pool is used first
+    thingpoolfree = NULL;
+    for (int16_t i = 0; i < _g_thingPoolSize; i++)
+    {
+        _g_thingPool[i].type  = MT_NOTHING;
+        _g_thingPool[i].snext = thingpoolfree;
+        thingpoolfree = &_g_thingPool[i];
+    }
+
+#if defined INSTRUMENTED
+    thingsinuse     = 0;
+    thingshighwater = 0;
+    thingoverflows  = 0;
+#endif
+}
+
+
 //
 // P_SpawnMobj
 //
 
 static mobj_t __far* P_NewMobj()
 {
-    mobj_t __far* mobj = NULL;
+    mobj_t __far* mobj = thingpoolfree;
+
+#if defined INSTRUMENTED
+    if (++thingsinuse > thingshighwater)
+        thingshighwater = thingsinuse;
+#endif
 
-    for(int16_t i = _g_thingPoolSize-1; i >= 0; i--)
+    if (mobj)
     {
-        if(_g_thingPool[i].type == MT_NOTHING)
-        {
-            mobj = &_g_thingPool[i];
-            _fmemset (mobj, 0, sizeof (*mobj));
+        thingpoolfree = mobj->snext;
+        _fmemset (mobj, 0, sizeof (*mobj));
 
-            mobj->pooled = true;
-            return mobj;
-        }
+        mobj->pooled = true;
     }
-
-    if(mobj == NULL)
+    else
     {
+#if defined INSTRUMENTED
+        thingoverflows++;
+#endif
         mobj = Z_MallocLevel(sizeof(*mobj), NULL);
         _fmemset (mobj, 0, sizeof (*mobj));
     }
@@ -707,6 +767,32 @@ static mobj_t __far* P_NewMobj()
     return mobj;
 }
 
+
+void P_FreeMobj(mobj_t __far* mobj)
+{
+#if defined INSTRUMENTED
+    thingsinuse--;
+#endif
+
+    if (mobj->pooled)
+    {
+        mobj->type  = MT_NOTHING;
+        mobj->snext = thingpoolfree;
+        thingpoolfree = mobj;
+    }
+    else
+        Z_Free(mobj);
+}
+
+
+#if defined INSTRUMENTED
+void P_PrintThingPoolStats(void)
+{
+    printf("Thing pool: %d things, at most %d things in use, %d allocated outside the pool\n",
+           _g_thingPoolSize, thingshighwater, thingoverflows);
+}
+#endif
+
 mobj_t __far* P_SpawnMobj(fixed_t x,fixed_t y,fixed_t z,mobjtype_t type)
 {
     const state_t*    st;
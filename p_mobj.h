@@ -293,5 +293,16 @@ void    P_SpawnMapThing (const mapthing_t __far* mthing);
 
 struct player_s* P_MobjIsPlayer(const mobj_t __far* mobj);
 
+#if defined TIC_HASH
+boolean P_IsThinkingMobj(const thinker_t __far* thinker);
+#endif
+
+void P_InitThingPool(int16_t numthings);
+void P_FreeMobj(mobj_t __far* mobj);
+
+#if defined INSTRUMENTED
+void P_PrintThingPoolStats(void);
+#endif
+
 #endif
 
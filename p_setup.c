@@ -61,6 +61,11 @@
 
 const seg_t    __far* _g_segs;
 
+#if defined VERTEX_ANGLE_CACHE
+const uint16_t __far* _g_segvertexnums; // v1 and v2 of every seg, as numbers of distinct vertices
+int16_t _g_numvertexes;
+#endif
+
 int16_t      _g_numsectors;
 sector_t __far* _g_sectors;
 
@@ -134,9 +139,67 @@ enum {
 // P_LoadSegs
 //
 
+#if defined VERTEX_ANGLE_CACHE
+//
+// P_NumberSegVertexes
+// Segs have their vertices by value,
+// so give every distinct vertex a number for the angle cache of the renderer.
+//
+
+#define P_SegVertex(i) (((i) & 1) ? &_g_segs[(i) / 2].v2 : &_g_segs[(i) / 2].v1)
+
+static void P_NumberSegVertexes(uint16_t numsegs)
+{
+    uint16_t __far* segvertexnums = Z_MallocLevel(numsegs * 2 * sizeof(uint16_t), NULL);
+
+    // more slots than seg vertices, so there is always an empty one
+    uint16_t size = 1;
+    while (size <= numsegs * 2)
+        size <<= 1;
+
+    // a slot holds the first seg vertex with its position + 1, or 0 if it's empty
+    uint16_t __far* hash = Z_CallocLevel(size * sizeof(uint16_t));
+    uint16_t mask = size - 1;
+
+    _g_numvertexes = 0;
+
+    for (uint16_t i = 0; i < numsegs * 2; i++)
+    {
+        const vertex_t __far* v = P_SegVertex(i);
+
+        uint16_t slot = W_NameHash(v->x, v->y) & mask;
+        while (hash[slot])
+        {
+            const vertex_t __far* other = P_SegVertex(hash[slot] - 1);
+            if (other->x == v->x && other->y == v->y)
+                break;
+
+            slot = (slot + 1) & mask;
+        }
+
+        if (hash[slot])
+            segvertexnums[i] = segvertexnums[hash[slot] - 1];
+        else
+        {
+            hash[slot] = i + 1;
+            segvertexnums[i] = _g_numvertexes++;
+        }
+    }
+
+    Z_Free(hash);
+
+    _g_segvertexnums = segvertexnums;
+}
+#endif
+
+
 static void P_LoadSegs (int16_t lump)
 {
     _g_segs = (const seg_t __far*)W_GetLumpByNumAutoFree(lump);
+
+#if defined VERTEX_ANGLE_CACHE
+    P_NumberSegVertexes(W_LumpLength(lump) / sizeof(seg_t));
+#endif
 }
 
 //
@@ -269,13 +332,7 @@ static void P_LoadThings (int16_t lump)
     int16_t  numthings = W_LumpLength (lump) / sizeof(mapthing_t);
     const mapthing_t __far* data = W_GetLumpByNum(lump);
 
-    _g_thingPool = Z_CallocLevel(numthings * sizeof(mobj_t));
-    _g_thingPoolSize = numthings;
-
-    for (int16_t i = 0; i < numthings; i++)
-    {
-        _g_thingPool[i].type = MT_NOTHING;
-    }
+    P_InitThingPool(numthings);
 
     for (int16_t i=0; i<numthings; i++)
     {
@@ -615,6 +672,24 @@ void P_SetupLevel(int16_t map)
 
     P_GroupLines();
 
+#if defined REJECT_PVS
+    R_InitPVS(W_LumpLength(lumpnum + ML_REJECT));
+#endif
+
+#if defined VERTEX_ANGLE_CACHE
+    R_InitVertexAngles();
+#endif
+
+#if defined ZONE_COMPACTION
+    // Close the gaps left by the previous level
+    Z_Compact();
+#endif
+
+#if defined TEXTURE_ATLAS && !defined FLAT_WALL
+    // The sidedefs have loaded the textures of the level
+    R_InitTextureAtlas();
+#endif
+
     // Note: you don't need to clear player queue slots
     // a much simpler fix is in g_game.c
 
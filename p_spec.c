@@ -83,6 +83,23 @@ void P_InitPicAnims (void)
 	                           R_CheckTextureNumForName ("SLADRIP3");
 }
 
+
+#if defined TEXTURE_ATLAS
+//
+// P_LoadAnimatedTexture
+// Loads the other frames too when the texture is animated,
+// they have to be in the texture atlas before the animation switches to them.
+//
+void P_LoadAnimatedTexture(int16_t texture)
+{
+	if (animated_texture_basepic <= texture && texture < animated_texture_basepic + 3)
+	{
+		for (int16_t i = animated_texture_basepic; i < animated_texture_basepic + 3; i++)
+			R_GetTexture(i);
+	}
+}
+#endif
+
 ///////////////////////////////////////////////////////////////
 //
 // Linedef and Sector Special Implementation Utility Functions
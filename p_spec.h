@@ -307,6 +307,10 @@ void P_InitSwitchList
 void P_SpawnSpecials
 ( void );
 
+#if defined TEXTURE_ATLAS
+void P_LoadAnimatedTexture(int16_t texture);
+#endif
+
 // every tic
 void P_UpdateSpecials(void);
 void P_UpdateAnimatedFlat(void);
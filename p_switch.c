@@ -121,6 +121,10 @@ void P_LoadTexture(int16_t texture)
 {
 	R_GetTexture(texture);
 
+#if defined TEXTURE_ATLAS
+	P_LoadAnimatedTexture(texture);
+#endif
+
 	for (int16_t i = 0; i < numswitches * 2; i++)
 	{
 		if (switchlist[i] == texture)
@@ -122,12 +122,7 @@ static void P_RemoveThingDelayed(thinker_t __far* thinker)
          * thinker->prev->next = thinker->next */
     (next->prev = thinker->prev)->next = next;
 
-    mobj_t __far* thing = (mobj_t __far*)thinker;
-
-    if (thing->pooled)
-        thing->type = MT_NOTHING;
-    else
-        Z_Free(thinker);
+    P_FreeMobj((mobj_t __far*)thinker);
 }
 
 //
@@ -193,6 +188,22 @@ static void P_RunThinkers (void)
 }
 
 
+#if defined TIC_HASH
+//
+// P_IterateThinkers
+// Calls func for every thinker, in the order they think.
+//
+
+void P_IterateThinkers(void (*func)(const thinker_t __far* thinker))
+{
+    const thinker_t __far* th;
+
+    for (th = _g_thinkerclasscap.next; th != &_g_thinkerclasscap; th = th->next)
+        func(th);
+}
+#endif
+
+
 void P_Ticker (void)
 {
   P_MapStart();
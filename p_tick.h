@@ -48,5 +48,9 @@ void P_AddThinker(thinker_t __far* thinker);
 void P_RemoveThinker(thinker_t __far* thinker);
 void P_RemoveThing(mobj_t __far* thing);
 
+#if defined TIC_HASH
+void P_IterateThinkers(void (*func)(const thinker_t __far* thinker));
+#endif
+
 
 #endif
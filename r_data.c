@@ -140,7 +140,7 @@ static void R_LoadTexture(int16_t texture_num)
 
     const maptexture_t __far* mtexture = (const maptexture_t __far*) ((const byte __far*)maptex + directory[texture_num]);
 
-    texture_t __far* texture = Z_MallocLevel(sizeof(const texture_t) + sizeof(const texpatch_t)*(mtexture->patchcount-1), (void __far*__far*)&textures[texture_num]);
+    texture_t __far* texture = Z_MallocLevelMovable(sizeof(const texture_t) + sizeof(const texpatch_t)*(mtexture->patchcount-1), (void __far*__far*)&textures[texture_num]);
 
     texture->width      = mtexture->width;
     texture->height     = mtexture->height;
@@ -156,6 +156,9 @@ static void R_LoadTexture(int16_t texture_num)
     const mappatch_t __far* mpatch = mtexture->patches;
 
     texture->overlapped = false;
+#if defined TEXTURE_ATLAS
+    texture->atlas      = NULL;
+#endif
 
     //Skip to list of names.
     pnames += 4;
@@ -232,6 +235,23 @@ const texture_t __far* R_GetTexture(int16_t texture)
     return textures[texture];
 }
 
+#if defined TEXTURE_ATLAS
+void R_IterateLoadedTextures(void (*func)(texture_t __far* tex))
+{
+    for (int16_t i = 0; i < numtextures; i++)
+    {
+        if (textures[i])
+            func((texture_t __far*)textures[i]);
+    }
+}
+#endif
+
+// Open addressing hash of the texture names, like the lump names in w_wad.c.
+// Slots hold the texture number, or -1 when empty.
+static uint32_t __far* texturenames; // Two halves of the name per texture
+static int16_t  __far* texturehash;
+static uint16_t texturehashmask;
+
 static int16_t R_GetTextureNumForName(const char* tex_name)
 {
     char tex_name_temp[8];
@@ -239,19 +259,13 @@ static int16_t R_GetTextureNumForName(const char* tex_name)
     uint32_t tex_name_int1 = *(uint32_t*)&tex_name_temp[0];
     uint32_t tex_name_int2 = *(uint32_t*)&tex_name_temp[4];
 
-    const int32_t __far* maptex = W_GetLumpByName("TEXTURE1");
-    const int32_t __far* directory = maptex+1;
-
-    for (int16_t i = 0; i < numtextures; i++)
+    for (uint16_t slot = W_NameHash(tex_name_int1, tex_name_int2) & texturehashmask; texturehash[slot] != -1; slot = (slot + 1) & texturehashmask)
     {
-        int32_t offset = *directory++;
-
-        const maptexture_t __far* mtexture = (const maptexture_t __far*) ( (const byte __far*)maptex + offset);
+        int16_t i = texturehash[slot];
 
-        if (tex_name_int1 == *(int32_t __far*)&mtexture->name[0]
-         && tex_name_int2 == *(int32_t __far*)&mtexture->name[4])
+        if (tex_name_int1 == texturenames[i * 2]
+         && tex_name_int2 == texturenames[i * 2 + 1])
         {
-            Z_ChangeTagToCache(maptex);
             return i;
         }
     }
@@ -293,10 +307,50 @@ int16_t PUREFUNC R_CheckTextureNumForName (const char *tex_name)
 //  with the textures from the world map.
 //
 
+// Z_MallocStatic allocates less than 64 kB, and probing needs a free slot
+#define MAXTEXTUREHASHSIZE 16384
+#define MAXTEXTURES (0xffff / (2 * sizeof(*texturenames)))
+
+static void R_InitTextureHash(const int32_t __far* maptex)
+{
+	const int32_t __far* directory = maptex+1;
+
+	if (numtextures > MAXTEXTURES)
+		I_Error("R_InitTextureHash: %i textures, at most %i are supported", numtextures, (int16_t)MAXTEXTURES);
+
+	uint32_t size = 2;
+	while (size < (uint32_t)numtextures * 2 && size < MAXTEXTUREHASHSIZE)
+		size <<= 1;
+
+	texturenames = Z_MallocStatic(numtextures * 2 * sizeof(*texturenames));
+	texturehash  = Z_MallocStatic(size * sizeof(*texturehash));
+	_fmemset(texturehash, 0xff, size * sizeof(*texturehash));
+	texturehashmask = size - 1;
+
+	for (int16_t i = 0; i < numtextures; i++)
+	{
+		const maptexture_t __far* mtexture = (const maptexture_t __far*) ((const byte __far*)maptex + directory[i]);
+
+		uint32_t name_int1 = *(uint32_t __far*)&mtexture->name[0];
+		uint32_t name_int2 = *(uint32_t __far*)&mtexture->name[4];
+		texturenames[i * 2]     = name_int1;
+		texturenames[i * 2 + 1] = name_int2;
+
+		uint16_t slot = W_NameHash(name_int1, name_int2) & texturehashmask;
+
+		while (texturehash[slot] != -1)
+			slot = (slot + 1) & texturehashmask;
+
+		texturehash[slot] = i;
+	}
+}
+
+
 static void R_InitTextures()
 {
 	const int32_t __far* mtex1 = W_GetLumpByName("TEXTURE1");
 	numtextures = *mtex1;
+	R_InitTextureHash(mtex1);
 	Z_ChangeTagToCache(mtex1);
 
 	textures = Z_MallocStatic(numtextures*sizeof*textures);
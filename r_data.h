@@ -65,6 +65,9 @@ typedef struct
   uint16_t  widthmask;
   // CPhipps - end of additions
   int16_t width, height;
+#if defined TEXTURE_ATLAS
+  const byte __far* atlas; // Composed columns of an overlapped texture
+#endif
 
   uint8_t overlapped;
   uint8_t patchcount;      // All the patches[patchcount] are drawn
@@ -92,6 +95,9 @@ int16_t R_FlatNumForName (const char* name);   // killough -- const added
 int16_t R_CheckTextureNumForName (const char *name);
 
 const texture_t __far* R_GetTexture(int16_t texture);
+#if defined TEXTURE_ATLAS
+void R_IterateLoadedTextures(void (*func)(texture_t __far* tex));
+#endif
 void P_LoadTexture(int16_t texture);
 
 
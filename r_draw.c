@@ -302,6 +302,15 @@ static angle_t   viewangle;
 static angle16_t viewangle16;
 
 static byte solidcol[VIEWWINDOWWIDTH];
+static int16_t solidcolumns; // number of columns in solidcol that are set
+
+#if defined INSTRUMENTED
+static uint32_t bspframes;
+static uint32_t bspnodesskipped; // back sides not checked because every column was solid
+#if defined REJECT_PVS
+static uint32_t bsppvsskipped;   // nodes and subsectors outside the PVS
+#endif
+#endif
 
 static const seg_t     __far* curline;
 static side_t    __far* sidedef;
@@ -989,6 +998,194 @@ typedef struct vissprite_s
 void R_DrawFuzzColumn (const draw_column_vars_t *dcvars);
 
 
+// The threads draw the deferred columns
+#if defined THREADED_COLUMNS && !defined DEFERRED_COLUMNS
+#define DEFERRED_COLUMNS
+#endif
+
+#if defined DEFERRED_COLUMNS
+//
+// Deferred columns
+// The columns are recorded while the BSP is traversed and drawn
+// afterwards, in the same order, so the output doesn't change.
+// With THREADED_COLUMNS every thread draws the columns
+// of its own band of the view window. The commands of a column
+// are still drawn in order, and a fuzz column starts where it would
+// have started in the fuzz table, so the output doesn't change either.
+// The texels of a column are copied, because the patch or composed
+// column they come from can be purged or reused before then.
+//
+#if defined _M_I86
+#error DEFERRED_COLUMNS needs a flat memory model
+#endif
+
+#if !defined DEFERRED_COLUMNS_MAX
+#define DEFERRED_COLUMNS_MAX 4096
+#endif
+
+#define DEFERRED_TEXELS_SIZE (DEFERRED_COLUMNS_MAX * 64)
+
+// kind of command, a flat column has its color as kind
+#define DC_COLUMN	-1
+#define DC_FUZZ		-2
+
+typedef struct
+{
+    draw_column_vars_t dcvars;
+    int16_t kind;
+#if defined THREADED_COLUMNS
+    int16_t fuzzpos;
+#endif
+} columncommand_t;
+
+static columncommand_t columncommands[DEFERRED_COLUMNS_MAX];
+static int16_t numcolumncommands;
+
+// The first 128 bytes are never used,
+// so a source pointer in front of the copied texels stays within the array.
+static byte deferredtexels[128 + DEFERRED_TEXELS_SIZE];
+static uint32_t deferredtexelsused = 128;
+
+
+#if defined THREADED_COLUMNS
+// The position in the fuzz table of the next fuzz column
+static int16_t deferredfuzzpos;
+#endif
+
+
+static void R_DrawDeferredColumnBand(int16_t band, int16_t bands)
+{
+    const int16_t x1 = (VIEWWINDOWWIDTH *  band     ) / bands;
+    const int16_t x2 = (VIEWWINDOWWIDTH * (band + 1)) / bands;
+
+    for (int16_t i = 0; i < numcolumncommands; i++)
+    {
+        const columncommand_t* cmd = &columncommands[i];
+
+        if (cmd->dcvars.x < x1 || x2 <= cmd->dcvars.x)
+            continue;
+
+        if (cmd->kind == DC_COLUMN)
+            R_DrawColumn(&cmd->dcvars);
+        else if (cmd->kind == DC_FUZZ)
+#if defined THREADED_COLUMNS
+            R_DrawFuzzColumnAt(&cmd->dcvars, cmd->fuzzpos);
+#else
+            R_DrawFuzzColumn(&cmd->dcvars);
+#endif
+        else
+            R_DrawColumnFlat(cmd->kind, &cmd->dcvars);
+    }
+}
+
+
+static void R_DrawDeferredColumns(void)
+{
+#if defined THREADED_COLUMNS
+    I_RunParallel(R_DrawDeferredColumnBand);
+#else
+    R_DrawDeferredColumnBand(0, 1);
+#endif
+
+    numcolumncommands  = 0;
+    deferredtexelsused = 128;
+}
+
+
+static columncommand_t* R_NewColumnCommand(int16_t kind, const draw_column_vars_t *dcvars, uint16_t texels)
+{
+    if (numcolumncommands == DEFERRED_COLUMNS_MAX || deferredtexelsused + texels > sizeof(deferredtexels))
+        R_DrawDeferredColumns();
+
+    columncommand_t* cmd = &columncommands[numcolumncommands++];
+    cmd->dcvars = *dcvars;
+    cmd->kind   = kind;
+    return cmd;
+}
+
+
+static void R_DeferColumn(const draw_column_vars_t *dcvars)
+{
+    // Zero length, R_DrawColumn wouldn't draw anything
+    if (dcvars->yh < dcvars->yl)
+        return;
+
+    // R_DrawColumn steps through the texels in 7.9 fixed point,
+    // wrapping around every 128 texels
+    const uint16_t fracstep = dcvars->iscale >> 7;
+    const uint16_t frac     = (dcvars->texturemid + (dcvars->yl - CENTERY) * dcvars->iscale) >> 7;
+    const uint32_t fracend  = frac + (uint32_t)(dcvars->yh - dcvars->yl) * fracstep;
+
+    // Only the texels from first to last are read and copied,
+    // the source can be a short post at the end of a lump
+    int16_t first, last;
+    if (fracend <= 0xffff)
+    {
+        first = frac    >> 9;
+        last  = fracend >> 9;
+    }
+    else if (fracstep <= (1 << 9))
+    {
+        // not more than a texel per pixel,
+        // so both the last and the first texel are read when it wraps around
+        first = 0;
+        last  = 127;
+    }
+    else
+    {
+        first = 127;
+        last  = 0;
+
+        uint16_t f = frac;
+        for (int16_t count = dcvars->yh - dcvars->yl + 1; count; count--)
+        {
+            if ((f >> 9) < first)
+                first = f >> 9;
+            if ((f >> 9) > last)
+                last = f >> 9;
+
+            f += fracstep;
+        }
+    }
+
+    const uint16_t count = last - first + 1;
+    columncommand_t* cmd = R_NewColumnCommand(DC_COLUMN, dcvars, count);
+
+    byte* texels = &deferredtexels[deferredtexelsused] - first;
+    _fmemcpy(texels + first, dcvars->source + first, count);
+    deferredtexelsused += count;
+
+    cmd->dcvars.source = texels;
+}
+
+
+static void R_DeferColumnFlat(int16_t texture, const draw_column_vars_t *dcvars)
+{
+    R_NewColumnCommand(texture, dcvars, 0);
+}
+
+
+static void R_DeferFuzzColumn(const draw_column_vars_t *dcvars)
+{
+#if defined THREADED_COLUMNS
+    columncommand_t* cmd = R_NewColumnCommand(DC_FUZZ, dcvars, 0);
+    cmd->fuzzpos = deferredfuzzpos;
+    deferredfuzzpos = R_SkipFuzzColumn(dcvars, deferredfuzzpos);
+#else
+    R_NewColumnCommand(DC_FUZZ, dcvars, 0);
+#endif
+}
+
+#define R_RenderColumn		R_DeferColumn
+#define R_RenderColumnFlat	R_DeferColumnFlat
+#define R_RenderFuzzColumn	R_DeferFuzzColumn
+#else
+#define R_RenderColumn		R_DrawColumn
+#define R_RenderColumnFlat	R_DrawColumnFlat
+#define R_RenderFuzzColumn	R_DrawFuzzColumn
+#endif
+
+
 //
 // R_DrawVisSprite
 //  mfloorclip and mceilingclip should also be set.
@@ -998,7 +1195,7 @@ static void R_DrawVisSprite(const vissprite_t *vis)
 {
     fixed_t  frac;
 
-    R_DrawColumn_f colfunc = R_DrawColumn;
+    R_DrawColumn_f colfunc = R_RenderColumn;
     draw_column_vars_t dcvars;
     dcvars.colormap = vis->colormap;
 
@@ -1006,7 +1203,7 @@ static void R_DrawVisSprite(const vissprite_t *vis)
     // mixed with translucent/non-translucenct 2s normals
 
     if (!dcvars.colormap)   // NULL colormap = shadow draw
-        colfunc = R_DrawFuzzColumn;    // killough 3/14/98
+        colfunc = R_RenderFuzzColumn;    // killough 3/14/98
 
     // proff 11/06/98: Changed for high-res
     dcvars.iscale = vis->iscale;
@@ -1147,7 +1344,7 @@ static void R_RenderMaskedSegRange(const drawseg_t *ds, int16_t x1, int16_t x2)
             const patch_t __far* patch = W_GetLumpByNum(patch_num);
             const column_t __far* column = (const column_t __far*) ((const byte __far*)patch + (uint16_t)patch->columnofs[x_c]);
 
-            R_DrawMaskedColumn(R_DrawColumn, &dcvars, column);
+            R_DrawMaskedColumn(R_RenderColumn, &dcvars, column);
             Z_ChangeTagToCache(patch);
             maskedtexturecol[dcvars.x] = SHRT_MAX; // dropoff overflow
         }
@@ -1667,7 +1864,7 @@ static void R_AddSprites(subsector_t __far* subsec, int16_t lightlevel)
 
 
 #if defined FLAT_WALL
-#define R_DrawSegTextureColumn(x,y,z) R_DrawColumnFlat(x,z)
+#define R_DrawSegTextureColumn(x,y,z) R_RenderColumnFlat(x,z)
 #else
 static void R_DrawColumnInCache(const column_t __far* patch, byte* cache, int16_t originy, int16_t cacheheight)
 {
@@ -1699,12 +1896,133 @@ static void R_DrawColumnInCache(const column_t __far* patch, byte* cache, int16_
  * straight from const patch_t*.
 */
 
-#define CACHE_WAYS 4
+// Distant walls are drawn with fewer composed columns
+static int16_t R_GetComposedColumn(const texture_t __far* tex, int16_t texcolumn, uint16_t iscale)
+{
+    uint16_t colmask = 0xfffe;
+
+    if (tex->width > 8)
+    {
+        if (iscale > 4)
+            colmask = 0xfff0;
+        else if (iscale > 3)
+            colmask = 0xfff8;
+        else if (iscale > 2)
+            colmask = 0xfffc;
+    }
+
+
+    return (texcolumn & colmask) & tex->widthmask;
+}
+
+#if defined TEXTURE_ATLAS
+#if defined _M_I86
+#error TEXTURE_ATLAS needs a flat memory model
+#endif
+
+// All overlapped textures of the level are composed at level load
+// into one block, column after column, each column padded to 4 bytes.
+// R_DrawColumn reads up to 128 bytes from the start of a column.
+#define ATLAS_PADDING 128
+
+static uint32_t textureatlassize;
+static byte __far* textureatlasnext;
+
+static uint16_t R_GetAtlasColumnSize(const texture_t __far* tex)
+{
+    return (tex->height + 3) & ~3;
+}
+
+static void R_SizeTextureInAtlas(texture_t __far* tex)
+{
+    if (tex->overlapped)
+        textureatlassize += (uint32_t)(tex->widthmask + 1) * R_GetAtlasColumnSize(tex);
+}
+
+static void R_ComposeTextureInAtlas(texture_t __far* tex)
+{
+    if (!tex->overlapped)
+        return;
+
+    const uint16_t colsize = R_GetAtlasColumnSize(tex);
+    const int16_t  width   = tex->widthmask + 1;
+
+    for (uint8_t i = 0; i < tex->patchcount; i++)
+    {
+        const texpatch_t __far* patch = &tex->patches[i];
+        const patch_t __far* realpatch = W_GetLumpByNum(patch->patch_num);
+
+        int16_t x1 = patch->originx;
+        int16_t x2 = x1 + realpatch->width;
+
+        if (x1 < 0)
+            x1 = 0;
+
+        if (x2 > width)
+            x2 = width;
+
+        for (int16_t xc = x1; xc < x2; xc++)
+        {
+            const column_t __far* patchcol = (const column_t __far*)((const byte __far*)realpatch + (uint16_t)realpatch->columnofs[xc - patch->originx]);
+
+            R_DrawColumnInCache(patchcol, (byte*)&textureatlasnext[(uint32_t)xc * colsize], patch->originy, tex->height);
+        }
+
+        Z_ChangeTagToCache(realpatch);
+    }
+
+    tex->atlas = textureatlasnext;
+    textureatlasnext += (uint32_t)width * colsize;
+}
+
+void R_InitTextureAtlas(void)
+{
+    textureatlassize = 0;
+    R_IterateLoadedTextures(R_SizeTextureInAtlas);
+
+    if (textureatlassize == 0)
+        return;
+
+    textureatlasnext = Z_CallocLevelLarge(textureatlassize + ATLAS_PADDING);
+    R_IterateLoadedTextures(R_ComposeTextureInAtlas);
+}
+
+static const byte __far* R_GetAtlasColumn(int16_t texture, const texture_t __far* tex, int16_t texcolumn, uint16_t iscale)
+{
+    // A texture loaded after level load isn't in the atlas
+    if (!tex->atlas)
+        I_Error("R_GetAtlasColumn: Texture %d not in atlas", texture);
+
+    const int16_t xc = R_GetComposedColumn(tex, texcolumn, iscale);
+
+    return tex->atlas + xc * R_GetAtlasColumnSize(tex);
+}
+
+#else
+
+
+// Number of composed columns, each takes 128 bytes.
+// Sets are indexed by (column/2 ^ texture), so more than 256 sets buy nothing.
+#if !defined COLUMN_CACHE_SIZE
+#define COLUMN_CACHE_SIZE 128
+#endif
+
+#if !defined COLUMN_CACHE_WAYS
+#define COLUMN_CACHE_WAYS 4
+#endif
+
+#define CACHE_WAYS COLUMN_CACHE_WAYS
 
 #define CACHE_MASK (CACHE_WAYS-1)
-#define CACHE_STRIDE (128 / CACHE_WAYS)
+#define CACHE_STRIDE (COLUMN_CACHE_SIZE / CACHE_WAYS)
 #define CACHE_KEY_MASK (CACHE_STRIDE-1)
 
+typedef char assertColumnCacheWays[(CACHE_WAYS & CACHE_MASK) == 0 ? 1 : -1];
+typedef char assertColumnCacheSize[(COLUMN_CACHE_SIZE & (COLUMN_CACHE_SIZE-1)) == 0 && COLUMN_CACHE_SIZE >= CACHE_WAYS ? 1 : -1];
+#if defined _M_I86
+typedef char assertColumnCacheSegment[COLUMN_CACHE_SIZE <= 512 ? 1 : -1];
+#endif
+
 static uint16_t CACHE_ENTRY(int16_t column, int16_t texture)
 {
 	return column | (texture << 8);
@@ -1715,8 +2033,84 @@ static uint16_t CACHE_HASH(int16_t column, int16_t texture)
 	return ((column >> 1) ^ texture) & CACHE_KEY_MASK;
 }
 
-static byte __far columnCache[128*128];
-static uint16_t columnCacheEntries[128];
+static byte __far columnCache[COLUMN_CACHE_SIZE*128];
+static uint16_t columnCacheEntries[COLUMN_CACHE_SIZE];
+
+#if defined COLUMN_CACHE_LRU
+// Evict the way of a set that was used longest ago
+static uint32_t columnCacheLastUse[COLUMN_CACHE_SIZE];
+static uint32_t columnCacheClock;
+#elif defined COLUMN_CACHE_CLOCK
+// Second chance: the hand of a set skips, and clears, recently used ways
+static boolean columnCacheReferenced[COLUMN_CACHE_SIZE];
+static uint8_t columnCacheHand[CACHE_STRIDE];
+#endif
+
+#if defined INSTRUMENTED
+static uint32_t columnCacheHits;
+static uint32_t columnCacheMisses;
+static uint32_t columnCacheEvictions;
+
+void R_PrintColumnCacheStats(void)
+{
+    uint32_t lookups = columnCacheHits + columnCacheMisses;
+    uint32_t hitrate = lookups ? (uint32_t)(((uint64_t)columnCacheHits * 1000) / lookups) : 0;
+
+    printf("Column cache (%d entries, %d ways): %lu lookups, %lu hits (%lu.%lu%%), %lu misses, %lu evictions\n",
+           COLUMN_CACHE_SIZE, CACHE_WAYS, (unsigned long) lookups,
+           (unsigned long) columnCacheHits, (unsigned long) (hitrate / 10), (unsigned long) (hitrate % 10),
+           (unsigned long) columnCacheMisses, (unsigned long) columnCacheEvictions);
+
+    columnCacheHits      = 0;
+    columnCacheMisses    = 0;
+    columnCacheEvictions = 0;
+}
+#endif
+
+static void TouchColumnCacheItem(uint16_t cachekey)
+{
+#if defined COLUMN_CACHE_LRU
+    columnCacheLastUse[cachekey] = ++columnCacheClock;
+#elif defined COLUMN_CACHE_CLOCK
+    columnCacheReferenced[cachekey] = true;
+#else
+    UNUSED(cachekey);
+#endif
+}
+
+static uint16_t EvictColumnCacheItem(uint16_t key)
+{
+#if defined COLUMN_CACHE_LRU
+    uint16_t victim = key;
+
+    for (uint16_t i = key + CACHE_STRIDE; i < COLUMN_CACHE_SIZE; i += CACHE_STRIDE)
+    {
+        if (columnCacheLastUse[i] < columnCacheLastUse[victim])
+            victim = i;
+    }
+
+    return victim;
+#elif defined COLUMN_CACHE_CLOCK
+    uint8_t hand = columnCacheHand[key];
+
+    while (true)
+    {
+        uint16_t i = (hand * CACHE_STRIDE) + key;
+
+        hand = (hand + 1) & CACHE_MASK;
+
+        if (!columnCacheReferenced[i])
+        {
+            columnCacheHand[key] = hand;
+            return i;
+        }
+
+        columnCacheReferenced[i] = false;
+    }
+#else
+    return ((M_Random() & CACHE_MASK) * CACHE_STRIDE) + key;
+#endif
+}
 
 static uint16_t FindColumnCacheItem(int16_t texture, int16_t column)
 {
@@ -1738,41 +2132,28 @@ static uint16_t FindColumnCacheItem(int16_t texture, int16_t column)
         cc+=CACHE_STRIDE;
         i+=CACHE_STRIDE;
 
-    } while(i < 128);
+    } while(i < COLUMN_CACHE_SIZE);
 
 
-    //No space. Random eviction.
-    return ((M_Random() & CACHE_MASK) * CACHE_STRIDE) + key;
+    //No space.
+    return EvictColumnCacheItem(key);
 }
 
 
 static const byte __far* R_ComposeColumn(const int16_t texture, const texture_t __far* tex, int16_t texcolumn, uint16_t iscale)
 {
-    uint16_t colmask = 0xfffe;
-
-    if (tex->width > 8)
-    {
-        if (iscale > 4)
-            colmask = 0xfff0;
-        else if (iscale > 3)
-            colmask = 0xfff8;
-        else if (iscale > 2)
-            colmask = 0xfffc;
-    }
-
-
-    const int16_t xc = (texcolumn & colmask) & tex->widthmask;
+    const int16_t xc = R_GetComposedColumn(tex, texcolumn, iscale);
 
     uint16_t cachekey = FindColumnCacheItem(texture, xc);
 
     byte __far* colcache = &columnCache[cachekey*128];
     uint16_t cacheEntry = columnCacheEntries[cachekey];
 
-    //total++;
-
     if (cacheEntry != CACHE_ENTRY(xc, texture))
     {
-        //misses++;
+#if defined INSTRUMENTED
+        columnCacheMisses++;
+#endif
         byte tmpCache[128];
 
         uint8_t i = 0;
@@ -1805,11 +2186,22 @@ static const byte __far* R_ComposeColumn(const int16_t texture, const texture_t
         //Block copy will drop low 2 bits of len.
         _fmemcpy(colcache, tmpCache, (tex->height + 3) & ~3);
 
+#if defined INSTRUMENTED
+        if (cacheEntry != 0)
+            columnCacheEvictions++;
+#endif
         columnCacheEntries[cachekey] = CACHE_ENTRY(xc, texture);
     }
+#if defined INSTRUMENTED
+    else
+        columnCacheHits++;
+#endif
+
+    TouchColumnCacheItem(cachekey);
 
     return colcache;
 }
+#endif
 
 static void R_DrawSegTextureColumn(int16_t texture, int16_t texcolumn, draw_column_vars_t* dcvars)
 {
@@ -1823,26 +2215,31 @@ static void R_DrawSegTextureColumn(int16_t texture, int16_t texcolumn, draw_colu
 
         const patch_t __far* patch = W_TryGetLumpByNum(patch_num);
         if (patch == NULL)
-            R_DrawColumnFlat(texture, dcvars);
+            R_RenderColumnFlat(texture, dcvars);
         else
         {
             const column_t __far* column = (const column_t __far*) ((const byte __far*)patch + (uint16_t)patch->columnofs[x_c]);
 
             dcvars->source = (const byte __far*)column + 3;
-            R_DrawColumn (dcvars);
+            R_RenderColumn (dcvars);
             Z_ChangeTagToCache(patch);
         }
     }
     else
     {
+#if defined TEXTURE_ATLAS
+        dcvars->source = R_GetAtlasColumn(texture, tex, texcolumn, dcvars->iscale >> FRACBITS);
+        R_RenderColumn (dcvars);
+#else
         const byte __far* source = R_ComposeColumn(texture, tex, texcolumn, dcvars->iscale >> FRACBITS);
         if (source == NULL)
-            R_DrawColumnFlat(texture, dcvars);
+            R_RenderColumnFlat(texture, dcvars);
         else
         {
             dcvars->source = source;
-            R_DrawColumn (dcvars);
+            R_RenderColumn (dcvars);
         }
+#endif
     }
 }
 #endif
@@ -1895,7 +2292,7 @@ static void R_RenderSegLoop(int16_t rw_x, boolean segtextured, boolean markfloor
             {
                 dcvars.yl = top;
                 dcvars.yh = bottom;
-                R_DrawColumnFlat(ceilingplane_color, &dcvars);
+                R_RenderColumnFlat(ceilingplane_color, &dcvars);
             }
             // SoM: this should be set here
             cc_rwx = bottom;
@@ -1914,7 +2311,7 @@ static void R_RenderSegLoop(int16_t rw_x, boolean segtextured, boolean markfloor
             {
                 dcvars.yl = top;
                 dcvars.yh = bottom;
-                R_DrawColumnFlat(floorplane_color, &dcvars);
+                R_RenderColumnFlat(floorplane_color, &dcvars);
             }
             // SoM: This should be set here to prevent overdraw
             fc_rwx = top;
@@ -2025,6 +2422,7 @@ static void R_RenderSegLoop(int16_t rw_x, boolean segtextured, boolean markfloor
             if ((markceiling || markfloor) && (fc_rwx <= cc_rwx + 1))
             {
                 solidcol[rw_x] = 1;
+                solidcolumns++;
                 didsolidcol = true;
             }
 
@@ -2476,11 +2874,15 @@ static void R_ClipWallSegment(int16_t first, int16_t last, const boolean solid)
             else
                 to = p - solidcol;
 
+            // R_RenderSegLoop can make some of these columns solid too
+            int16_t solidbefore = solidcolumns;
+
             R_StoreWallRange(first, to-1);
 
             if (solid)
             {
                 memset(solidcol + first, 1, to - first);
+                solidcolumns = solidbefore + (to - first);
             }
 
             first = to;
@@ -2498,12 +2900,56 @@ static void R_ClipWallSegment(int16_t first, int16_t last, const boolean solid)
 // and adds any visible pieces to the line list.
 //
 
+#if defined VERTEX_ANGLE_CACHE
+//
+// Vertex angles
+// Neighbouring segs share vertices,
+// so the angle of every vertex is computed at most once per frame.
+//
+typedef struct
+{
+    uint16_t  frame;	// 0 if the angle has never been computed
+    angle16_t angle;
+} vertexangle_t;
+
+static vertexangle_t __far* vertexangles;
+
+// Like validcount, but only counts frames, so it's known when it wraps around
+static uint16_t vertexangleframe;
+
+
+void R_InitVertexAngles(void)
+{
+    vertexangles = Z_CallocLevel(_g_numvertexes * sizeof(vertexangle_t));
+}
+
+
+static angle16_t R_GetVertexAngle(uint16_t vertexnum, const vertex_t __far* v)
+{
+    vertexangle_t __far* va = &vertexangles[vertexnum];
+    if (va->frame != vertexangleframe)
+    {
+        va->frame = vertexangleframe;
+        va->angle = R_PointToAngle(v->x, v->y);
+    }
+
+    return va->angle;
+}
+#endif
+
+
 static void R_AddLine(const seg_t __far* line)
 {
     curline = line;
 
+#if defined VERTEX_ANGLE_CACHE
+    const uint16_t __far* vertexnums = &_g_segvertexnums[(line - _g_segs) * 2];
+    angle16_t angle1 = R_GetVertexAngle(vertexnums[0], &line->v1);
+    angle16_t angle2 = R_GetVertexAngle(vertexnums[1], &line->v2);
+#else
     angle16_t angle1 = R_PointToAngle(line->v1.x, line->v1.y);
     angle16_t angle2 = R_PointToAngle(line->v2.x, line->v2.y);
+#endif
 
     // Clip to view edges.
     angle16_t span = angle1 - angle2;
@@ -2683,26 +3129,105 @@ static boolean R_CheckBBox(const int16_t __far* bspcoord)
     return true;
 }
 
-//Render a BSP subsector if bspnum is a leaf node.
-//Return false if bspnum is frame node.
+#if defined REJECT_PVS
+//
+// Potentially visible set
+// Without the special effect, the REJECT lump tells
+// which sectors can't be seen from the sector of the camera.
+// Nodes that only contain such sectors are skipped.
+//
+static byte __far* pvsnodes;				// a bit per node, set if the node is potentially visible
+static const sector_t __far* pvssector;	// the sector of the camera pvsnodes has been built for
 
 
+static boolean R_IsSectorInPVS(const sector_t __far* sector)
+{
+    uint32_t pnum = (uint32_t)(pvssector - _g_sectors) * _g_numsectors + (sector - _g_sectors);
+    return sector == pvssector || !(_g_rejectmatrix[pnum >> 3] & (1 << (pnum & 7)));
+}
 
 
+static boolean R_MarkPVSNodes(int16_t bspnum)
+{
+    if (bspnum & NF_SUBSECTOR)
+        return R_IsSectorInPVS(_g_subsectors[bspnum == -1 ? 0 : bspnum & (~NF_SUBSECTOR)].sector);
+
+    const mapnode_t __far* bsp = &nodes[bspnum];
+
+    // both children have to be marked
+    boolean visible = R_MarkPVSNodes(bsp->children[0]);
+    visible |= R_MarkPVSNodes(bsp->children[1]);
+
+    if (visible)
+        pvsnodes[bspnum >> 3] |= 1 << (bspnum & 7);
+    else
+        pvsnodes[bspnum >> 3] &= ~(1 << (bspnum & 7));
+
+    return visible;
+}
+
+
+void R_InitPVS(uint16_t rejectlength)
+{
+    pvssector = NULL;
+    pvsnodes  = NULL;
+
+    // some PWADs have a REJECT lump that is too short
+    if (rejectlength < ((uint32_t)_g_numsectors * _g_numsectors + 7) / 8)
+        return;
+
+    pvsnodes = Z_CallocLevel((numnodes + 7) / 8);
+}
+
+
+static void R_SetupPVS(const sector_t __far* sector)
+{
+    if (pvsnodes && sector != pvssector)
+    {
+        pvssector = sector;
+        R_MarkPVSNodes(numnodes - 1);
+    }
+}
+#endif
+
+
+//Render a BSP subsector if bspnum is a leaf node.
+//Return false if bspnum is frame node.
+//With REJECT_PVS, nodes outside the PVS count as rendered.
+
 
 static boolean R_RenderBspSubsector(int16_t bspnum)
 {
     // Found a subsector?
     if (bspnum & NF_SUBSECTOR)
     {
-        if (bspnum == -1)
-            R_Subsector (0);
-        else
-            R_Subsector (bspnum & (~NF_SUBSECTOR));
+        int16_t num = bspnum == -1 ? 0 : bspnum & (~NF_SUBSECTOR);
+
+#if defined REJECT_PVS
+        if (pvsnodes && !R_IsSectorInPVS(_g_subsectors[num].sector))
+        {
+#if defined INSTRUMENTED
+            bsppvsskipped++;
+#endif
+            return true;
+        }
+#endif
+
+        R_Subsector (num);
 
         return true;
     }
 
+#if defined REJECT_PVS
+    if (pvsnodes && !(pvsnodes[bspnum >> 3] & (1 << (bspnum & 7))))
+    {
+#if defined INSTRUMENTED
+        bsppvsskipped++;
+#endif
+        return true;
+    }
+#endif
+
     return false;
 }
 
@@ -2748,6 +3273,15 @@ static void R_RenderBSPNode(int16_t bspnum)
             return;
         }
 
+        // Nothing behind the walls drawn so far is visible
+        if (solidcolumns == VIEWWINDOWWIDTH)
+        {
+#if defined INSTRUMENTED
+            bspnodesskipped += sp / 2;
+#endif
+            return;
+        }
+
         //Back sides.
         side = stack[--sp];
         bspnum = stack[--sp];
@@ -2789,6 +3323,15 @@ static void R_RenderBSPNode(int16_t bspnum)
 
 	R_RenderBSPNode(bsp->children[side]); // recursively divide front space
 
+	// Nothing behind the walls drawn so far is visible
+	if (solidcolumns == VIEWWINDOWWIDTH)
+	{
+#if defined INSTRUMENTED
+		bspnodesskipped++;
+#endif
+		return;
+	}
+
 	if (R_CheckBBox(bsp->bbox[side ^ 1]))	// possibly divide back space
 		R_RenderBSPNode(bsp->children[side ^ 1]);
 }
@@ -2803,9 +3346,29 @@ static void R_ClearDrawSegs(void)
 static void R_ClearClipSegs (void)
 {
     memset(solidcol, 0, VIEWWINDOWWIDTH);
+    solidcolumns = 0;
 }
 
 
+#if defined INSTRUMENTED
+void R_PrintBspStats(void)
+{
+    printf("BSP: %lu frames, %lu.%lu back sides per frame skipped because every column was solid\n",
+           (unsigned long) bspframes,
+           (unsigned long) (bspframes ? bspnodesskipped / bspframes : 0),
+           (unsigned long) (bspframes ? bspnodesskipped * 10 / bspframes % 10 : 0));
+
+    bspframes       = 0;
+    bspnodesskipped = 0;
+
+#if defined REJECT_PVS
+    printf("PVS: %lu nodes and subsectors skipped\n", (unsigned long) bsppvsskipped);
+    bsppvsskipped = 0;
+#endif
+}
+#endif
+
+
 //
 // R_SetupFrame
 //
@@ -2832,6 +3395,14 @@ static void R_SetupFrame (player_t *player)
         fixedcolormap = NULL;
 
     validcount++;
+
+#if defined VERTEX_ANGLE_CACHE
+    if (++vertexangleframe == 0)
+    {
+        _fmemset(vertexangles, 0, _g_numvertexes * sizeof(vertexangle_t));
+        vertexangleframe = 1;
+    }
+#endif
 }
 
 
@@ -2850,10 +3421,21 @@ void R_RenderPlayerView (player_t* player)
     R_ClearOpenings ();
     R_ClearSprites ();
 
+#if defined REJECT_PVS
+    R_SetupPVS(player->mo->subsector->sector);
+#endif
+
     // The head node is the last node output.
     R_RenderBSPNode (numnodes-1);
+#if defined INSTRUMENTED
+    bspframes++;
+#endif
 
     R_DrawMasked ();
+
+#if defined DEFERRED_COLUMNS
+    R_DrawDeferredColumns();
+#endif
 }
 
 
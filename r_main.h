@@ -87,5 +87,24 @@ void R_DrawColumnFlat(int16_t texture, const draw_column_vars_t *dcvars);
 
 byte R_GetPlaneColor(int16_t picnum, int16_t lightlevel);
 
+#if defined TEXTURE_ATLAS && !defined FLAT_WALL
+void R_InitTextureAtlas(void);
+#endif
+
+#if defined INSTRUMENTED && !defined FLAT_WALL && !defined TEXTURE_ATLAS
+void R_PrintColumnCacheStats(void);
+#endif
+#if defined INSTRUMENTED
+void R_PrintBspStats(void);
+#endif
+
+#if defined REJECT_PVS
+void R_InitPVS(uint16_t rejectlength);
+#endif
+
+#if defined VERTEX_ANGLE_CACHE
+void R_InitVertexAngles(void);
+#endif
+
 
 #endif
@@ -41,6 +41,12 @@
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if defined HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include <stdint.h>
 
@@ -71,18 +77,51 @@ typedef struct
 // GLOBALS
 //
 
+#if BYTE_ORDER == LITTLE_ENDIAN
+#define WADFILENAME "DOOMTD3L.WAD"
+#elif BYTE_ORDER == BIG_ENDIAN
+#define WADFILENAME "DOOMTD3B.WAD"
+#else
+#error unknown byte order
+#endif
+
+#if defined HAVE_MMAP
+// The whole WAD is mapped into memory,
+// lumps are handed out without copying them into the zone.
+static const uint8_t* wadmap;
+#else
 static FILE* fileWAD;
+#endif
 
 static int16_t numlumps;
 
-static filelump_t __far* fileinfo;
+static const filelump_t __far* fileinfo;
 
+#if !defined HAVE_MMAP
 static void __far*__far* lumpcache;
 
+#if defined INSTRUMENTED
+static uint32_t lumpcachehits;
+static uint32_t lumpreads;
+static uint32_t lumpreadbytes;
+static uint32_t lumprereads;		// of lumps that were purged from the cache
+static uint8_t __far* lumpwasread;
+#endif
+#endif
+
+// Open addressing hash of the lump names, linear probing.
+// Slots hold the lump number, or -1 when empty.
+static int16_t __far* lumphash;
+static uint16_t lumphashmask;
+
+// Z_MallocStatic allocates less than 64 kB, and probing needs a free slot
+#define MAXLUMPHASHSIZE 16384
+
 //
 // LUMP BASED ROUTINES.
 //
 
+#if !defined HAVE_MMAP
 #define BUFFERSIZE 512
 
 static void _ffread(void __far* ptr, uint16_t size, FILE* fp)
@@ -112,6 +151,7 @@ static void _ffread(void __far* ptr, uint16_t size, FILE* fp)
 	free(buffer);
 #endif
 }
+#endif
 
 typedef struct
 {
@@ -121,32 +161,91 @@ typedef struct
   int32_t  infotableofs;
 } wadinfo_t;
 
+// Hash of an 8 character name, passed as two 32-bit halves
+uint16_t PUREFUNC W_NameHash(uint32_t name_int1, uint32_t name_int2)
+{
+	uint32_t hash = (name_int1 ^ (name_int2 * 31)) * 0x9e3779b1;
+	return hash >> 16;
+}
+
+
+// Lumps are inserted in order, so the first of lumps
+// with the same name is found first, like before.
+static void W_InitLumpHash(void)
+{
+	if (numlumps >= MAXLUMPHASHSIZE)
+		I_Error("W_InitLumpHash: %i lumps, at most %i are supported", numlumps, MAXLUMPHASHSIZE - 1);
+
+	uint32_t size = 2;
+	while (size < (uint32_t)numlumps * 2 && size < MAXLUMPHASHSIZE)
+		size <<= 1;
+
+	lumphash = Z_MallocStatic(size * sizeof(*lumphash));
+	_fmemset(lumphash, 0xff, size * sizeof(*lumphash));
+	lumphashmask = size - 1;
+
+	for (int16_t i = 0; i < numlumps; i++)
+	{
+		uint16_t slot = W_NameHash(*(uint32_t __far*)&fileinfo[i].name[0], *(uint32_t __far*)&fileinfo[i].name[4]) & lumphashmask;
+
+		while (lumphash[slot] != -1)
+			slot = (slot + 1) & lumphashmask;
+
+		lumphash[slot] = i;
+	}
+}
+
+
+#if defined HAVE_MMAP
 void W_Init(void)
 {
-#if BYTE_ORDER == LITTLE_ENDIAN
-	fileWAD = fopen("DOOMTD3L.WAD", "rb");
-	if (fileWAD == NULL)
-		I_Error("Can't open DOOMTD3L.WAD.");
-#elif BYTE_ORDER == BIG_ENDIAN
-	fileWAD = fopen("DOOMTD3B.WAD", "rb");
-	if (fileWAD == NULL)
-		I_Error("Can't open DOOMTD3B.WAD.");
+	int fd = open(WADFILENAME, O_RDONLY);
+	if (fd == -1)
+		I_Error("Can't open " WADFILENAME ".");
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		I_Error("Can't stat " WADFILENAME ".");
+
+	// Private and writable like a lump in the zone, but never written back
+	void* ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (ptr == MAP_FAILED)
+		I_Error("Can't map " WADFILENAME ".");
+
+	close(fd);
+	wadmap = ptr;
+
+	const wadinfo_t* header = (const wadinfo_t*)wadmap;
+	fileinfo = (const filelump_t*)(wadmap + header->infotableofs);
+	numlumps = header->numlumps;
 #else
-#error unknown byte order
-#endif
+void W_Init(void)
+{
+	fileWAD = fopen(WADFILENAME, "rb");
+	if (fileWAD == NULL)
+		I_Error("Can't open " WADFILENAME ".");
 
 	wadinfo_t header;
 	fseek(fileWAD, 0, SEEK_SET);
 	fread(&header, sizeof(header), 1, fileWAD);
 
-	fileinfo = Z_MallocStatic(header.numlumps * sizeof(filelump_t));
+	filelump_t __far* info = Z_MallocStatic(header.numlumps * sizeof(filelump_t));
 	fseek(fileWAD, header.infotableofs, SEEK_SET);
-	_ffread(fileinfo, sizeof(filelump_t) * header.numlumps, fileWAD);
+	_ffread(info, sizeof(filelump_t) * header.numlumps, fileWAD);
+	fileinfo = info;
 
 	lumpcache = Z_MallocStatic(header.numlumps * sizeof(*lumpcache));
 	_fmemset(lumpcache, 0, header.numlumps * sizeof(*lumpcache));
 
+#if defined INSTRUMENTED
+	lumpwasread = Z_MallocStatic(header.numlumps);
+	_fmemset(lumpwasread, 0, header.numlumps);
+#endif
+
 	numlumps = header.numlumps;
+#endif
+
+	W_InitLumpHash();
 }
 
 
@@ -177,8 +276,10 @@ int16_t PUREFUNC W_GetNumForName(const char *name)
 	uint32_t name_int1 = *(uint32_t*)&name8[0];
 	uint32_t name_int2 = *(uint32_t*)&name8[4];
 
-	for (int16_t i = 0; i < numlumps; i++)
+	for (uint16_t slot = W_NameHash(name_int1, name_int2) & lumphashmask; lumphash[slot] != -1; slot = (slot + 1) & lumphashmask)
 	{
+		int16_t i = lumphash[slot];
+
 		if (name_int1 == *(uint32_t __far*)&fileinfo[i].name[0]
 		 && name_int2 == *(uint32_t __far*)&fileinfo[i].name[4])
 		{
@@ -191,6 +292,49 @@ int16_t PUREFUNC W_GetNumForName(const char *name)
 }
 
 
+#if defined HAVE_MMAP
+void W_ReadLumpByNum(int16_t num, void __far* ptr)
+{
+	_fmemcpy(ptr, wadmap + fileinfo[num].filepos, fileinfo[num].size);
+}
+
+
+const void __far* PUREFUNC W_GetLumpByNumAutoFree(int16_t num)
+{
+	return wadmap + fileinfo[num].filepos;
+}
+
+
+int16_t W_GetFirstInt16(int16_t num)
+{
+	return *(const int16_t*)(wadmap + fileinfo[num].filepos);
+}
+
+
+const void __far* PUREFUNC W_GetLumpByNum(int16_t num)
+{
+	return wadmap + fileinfo[num].filepos;
+}
+
+
+boolean PUREFUNC W_IsLumpCached(int16_t num)
+{
+	UNUSED(num);
+	return true;
+}
+
+
+const void __far* PUREFUNC W_TryGetLumpByNum(int16_t num)
+{
+	return wadmap + fileinfo[num].filepos;
+}
+
+
+// Every lump is already in memory
+void W_CacheLumps(void)
+{
+}
+#else
 void W_ReadLumpByNum(int16_t num, void __far* ptr)
 {
 	const filelump_t __far* lump = &fileinfo[num];
@@ -203,6 +347,9 @@ const void __far* PUREFUNC W_GetLumpByNumAutoFree(int16_t num)
 {
 	const filelump_t __far* lump = &fileinfo[num];
 
+#if defined INSTRUMENTED
+	Z_TraceLump(num);
+#endif
 	void __far* ptr = Z_MallocLevel(lump->size, NULL);
 
 	fseek(fileWAD, lump->filepos, SEEK_SET);
@@ -215,8 +362,19 @@ static void __far* PUREFUNC W_GetLumpByNumWithUser(int16_t num, void __far*__far
 {
 	const filelump_t __far* lump = &fileinfo[num];
 
+#if defined INSTRUMENTED
+	Z_TraceLump(num);
+#endif
 	void __far* ptr = Z_MallocStaticWithUser(lump->size, user);
 
+#if defined INSTRUMENTED
+	lumpreads++;
+	lumpreadbytes += lump->size;
+	if (lumpwasread[num])
+		lumprereads++;
+	lumpwasread[num] = true;
+#endif
+
 	fseek(fileWAD, lump->filepos, SEEK_SET);
 	_ffread(ptr, lump->size, fileWAD);
 	return ptr;
@@ -238,7 +396,12 @@ int16_t W_GetFirstInt16(int16_t num)
 const void __far* PUREFUNC W_GetLumpByNum(int16_t num)
 {
 	if (lumpcache[num])
+	{
+#if defined INSTRUMENTED
+		lumpcachehits++;
+#endif
 		Z_ChangeTagToStatic(lumpcache[num]);
+	}
 	else
 		lumpcache[num] = W_GetLumpByNumWithUser(num, &lumpcache[num]);
 
@@ -256,6 +419,9 @@ const void __far* PUREFUNC W_TryGetLumpByNum(int16_t num)
 {
 	if (lumpcache[num])
 	{
+#if defined INSTRUMENTED
+		lumpcachehits++;
+#endif
 		Z_ChangeTagToStatic(lumpcache[num]);
 		return lumpcache[num];
 	}
@@ -306,3 +472,19 @@ void W_CacheLumps(void)
 
 	Z_Free(lumpsToCache);
 }
+
+
+#if defined INSTRUMENTED
+void W_PrintLumpCacheStats(void)
+{
+	printf("Lump cache: %lu hits, %lu reads from the WAD (%lu bytes), %lu of them re-reads of purged lumps\n",
+	       (unsigned long) lumpcachehits, (unsigned long) lumpreads,
+	       (unsigned long) lumpreadbytes, (unsigned long) lumprereads);
+
+	lumpcachehits = 0;
+	lumpreads     = 0;
+	lumpreadbytes = 0;
+	lumprereads   = 0;
+}
+#endif
+#endif
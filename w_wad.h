@@ -44,6 +44,7 @@ void W_Init(void);
 void W_CacheLumps(void);
 
 int16_t           PUREFUNC W_GetNumForName(const char *name);
+uint16_t          PUREFUNC W_NameHash(uint32_t name_int1, uint32_t name_int2);
 const char __far* PUREFUNC W_GetNameForNum(       int16_t num);
 uint16_t          PUREFUNC W_LumpLength(          int16_t num);
 boolean           PUREFUNC W_IsLumpCached(        int16_t num);
@@ -55,4 +56,8 @@ void                       W_ReadLumpByNum(       int16_t num, void __far* ptr);
 
 #define W_GetLumpByName(x)    W_GetLumpByNum(W_GetNumForName(x))
 
+#if defined INSTRUMENTED && !defined HAVE_MMAP
+void W_PrintLumpCacheStats(void);
+#endif
+
 #endif
@@ -22,6 +22,10 @@
 //
 //-----------------------------------------------------------------------------
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdint.h>
 #include <stdlib.h>
 #include "compiler.h"
@@ -29,6 +33,11 @@
 #include "doomdef.h"
 #include "i_system.h"
 
+#if defined INSTRUMENTED
+#include <stdio.h>
+#include "globdata.h"
+#endif
+
 
 //
 // ZONE MEMORY
@@ -53,42 +62,103 @@
 //  because it will get overwritten automatically if needed.
 //
 
-#if defined INSTRUMENTED
-    static int32_t running_count = 0;
+#define	ZONEID	0x1dea
+
+
+// The segregated allocator purges cached blocks least recently used first
+#if (defined ZONE_SEGREGATED || defined ZONE_COMPACTION) && !defined ZONE_LRU
+#define ZONE_LRU
 #endif
 
 
-#define	ZONEID	0x1dea
+#if defined __LP64__
+// The zone and the user pointers into it live below 4 GB, see i_posix.c,
+// so a user pointer fits in 32 bits and the header fits in a paragraph.
+typedef uint32_t memuser_t;
+#define userToPointer(u) ((void __far*__far*)(uintptr_t)(u))
+#define pointerToUser(p) ((memuser_t)(uintptr_t)(p))
+#else
+typedef void __far*__far* memuser_t;
+#define userToPointer(u) (u)
+#define pointerToUser(p) (p)
+#endif
 
 typedef struct
 {
 #if SIZE_OF_SEGMENT_T == 2
     uint32_t  size;			// including the header and possibly tiny fragments
+#if defined ZONE_COMPACTION
+    uint8_t   tag;			// purgelevel
+    uint8_t   movable;		// the user is the only pointer to the block
+#else
     uint16_t  tag;			// purgelevel
+#endif
 #else
     uint32_t  size:24;		// including the header and possibly tiny fragments
     uint32_t  tag:4;		// purgelevel
+#if defined ZONE_COMPACTION
+    uint32_t  movable:1;	// the user is the only pointer to the block
+#endif
 #endif
-    void __far*__far*    user;	// NULL if a free block
+    memuser_t user;			// NULL if a free block
     segment_t next;
     segment_t prev;
 #if defined ZONEIDCHECK
     uint16_t id;			// should be ZONEID
 #endif
+#if defined ZONE_LRU
+    segment_t listnext;		// free list of the size class, or LRU list of PU_CACHE blocks
+    segment_t listprev;		// 0 at the ends of a list
+#endif
 } memblock_t;
 
 
-typedef char assertMemblockSize[sizeof(memblock_t) <= PARAGRAPH_SIZE ? 1 : -1];
+#if defined ZONE_LRU
+// The list links need a second paragraph
+#define HEADER_PARAGRAPHS 2
+#else
+#define HEADER_PARAGRAPHS 1
+#endif
+
+#define HEADER_SIZE (HEADER_PARAGRAPHS * PARAGRAPH_SIZE)
+
+typedef char assertMemblockSize[sizeof(memblock_t) <= HEADER_SIZE ? 1 : -1];
+
+#if defined _M_I86
+#define blockToPointer(b) ((void __far*)(((uint32_t)(b)) + HEADER_PARAGRAPHS * 0x00010000))
+#define pointerToBlock(p) ((memblock_t __far*)(((uint32_t)(p)) - HEADER_PARAGRAPHS * 0x00010000))
+#else
+#define blockToPointer(b) ((void __far*)(((uintptr_t)(b)) + HEADER_SIZE))
+#define pointerToBlock(p) ((memblock_t __far*)(((uintptr_t)(p)) - HEADER_SIZE))
+#endif
 
 
 static memblock_t __far* mainzone_sentinal;
 static segment_t   mainzone_rover_segment;
 
+#if defined CHECKHEAP
+// Z_CheckHeapIncremental continues here, 0 to start at the first block
+static segment_t   checkheap_segment;
+#endif
+
+// Summaries of the free and purgeable memory,
+// kept up to date by Z_AllocateBlock, Z_FreeBlock and Z_ChangeTag
+static uint32_t freememory;
+static uint32_t cachememory;
+
+#if defined HAVE_MMAP
+// Lumps of a memory mapped WAD are not zone blocks, see w_wad.c
+static uintptr_t zone_start;
+static uintptr_t zone_end;
+
+#define Z_IsZoneBlock(ptr) (zone_start <= (uintptr_t)(ptr) && (uintptr_t)(ptr) < zone_end)
+#endif
+
 
 static segment_t pointerToSegment(const memblock_t __far* ptr)
 {
 #if defined RANGECHECK
-	if ((((uint32_t) ptr) & (PARAGRAPH_SIZE - 1)) != 0)
+	if ((((uintptr_t) ptr) & (PARAGRAPH_SIZE - 1)) != 0)
 		I_Error("pointerToSegment: pointer is not aligned: 0x%lx", ptr);
 #endif
 
@@ -101,6 +171,288 @@ static memblock_t __far* segmentToPointer(segment_t seg)
 }
 
 
+#if defined INSTRUMENTED
+//
+// Allocation trace
+// Every change to the heap is recorded in a ring buffer,
+// without any I/O until the buffer is written to ZTRACE.BIN at exit.
+// ztrace.c turns the file into a timeline of the heap.
+//
+#if !defined ZONE_TRACE_EVENTS
+#if defined _M_I86
+#define ZONE_TRACE_EVENTS 2048
+#else
+#define ZONE_TRACE_EVENTS 262144
+#endif
+#endif
+
+typedef char assertZoneTraceEvents[(ZONE_TRACE_EVENTS & (ZONE_TRACE_EVENTS - 1)) == 0 ? 1 : -1];
+
+#define ZONETRACE_MAGIC "ZTRACE1"
+
+enum
+{
+	ZT_ALLOC,		// a block has been allocated
+	ZT_FREE,		// a block has been freed or purged
+	ZT_TAG,			// the tag of a block has changed
+	ZT_MOVEFROM,	// a block is moved by compaction, from here
+	ZT_MOVETO		// to here
+};
+
+typedef struct
+{
+	int16_t  tic;
+	int16_t  lump;		// -1 if unknown
+	uint8_t  op;
+	uint8_t  tag;
+	uint32_t offset;	// in paragraphs from the start of the zone
+	uint32_t size;		// including the header
+} zoneevent_t;
+
+static zoneevent_t __far zonetrace[ZONE_TRACE_EVENTS];
+static uint32_t  zonetracecount;
+static segment_t zonetracebase;
+static uint32_t  zonetracesize;		// in paragraphs
+static int16_t   zonetracelump = -1;
+
+
+// The next allocation is for this lump
+void Z_TraceLump(int16_t num)
+{
+	zonetracelump = num;
+}
+
+
+static void Z_Trace(uint_fast8_t op, const memblock_t __far* block)
+{
+	zoneevent_t __far* event = &zonetrace[zonetracecount & (ZONE_TRACE_EVENTS - 1)];
+	event->tic    = _g_gametic;
+	event->lump   = -1;
+	event->op     = op;
+	event->tag    = block->tag;
+	event->offset = pointerToSegment(block) - zonetracebase;
+	event->size   = block->size;
+
+	if (op == ZT_ALLOC)
+	{
+		event->lump   = zonetracelump;
+		zonetracelump = -1;
+	}
+
+	zonetracecount++;
+}
+
+
+static void Z_WriteTraceValue(uint8_t* record, uint32_t value, uint_fast8_t bytes)
+{
+	while (bytes--)
+	{
+		*record++ = value;
+		value >>= 8;
+	}
+}
+
+
+static void Z_WriteTrace(void)
+{
+	FILE* fp = fopen("ZTRACE.BIN", "wb");
+	if (!fp)
+		return;
+
+	uint32_t count = zonetracecount < ZONE_TRACE_EVENTS ? zonetracecount : ZONE_TRACE_EVENTS;
+
+	uint8_t header[sizeof(ZONETRACE_MAGIC) - 1 + 3 * 4];
+	memcpy(header, ZONETRACE_MAGIC, sizeof(ZONETRACE_MAGIC) - 1);
+	Z_WriteTraceValue(&header[sizeof(ZONETRACE_MAGIC) - 1 + 0], zonetracesize,  4);
+	Z_WriteTraceValue(&header[sizeof(ZONETRACE_MAGIC) - 1 + 4], zonetracecount, 4);
+	Z_WriteTraceValue(&header[sizeof(ZONETRACE_MAGIC) - 1 + 8], count,          4);
+	fwrite(header, sizeof(header), 1, fp);
+
+	// oldest first
+	for (uint32_t i = zonetracecount - count; i != zonetracecount; i++)
+	{
+		const zoneevent_t __far* event = &zonetrace[i & (ZONE_TRACE_EVENTS - 1)];
+
+		uint8_t record[14];
+		Z_WriteTraceValue(&record[0],  event->tic,    2);
+		Z_WriteTraceValue(&record[2],  event->lump,   2);
+		Z_WriteTraceValue(&record[4],  event->op,     1);
+		Z_WriteTraceValue(&record[5],  event->tag,    1);
+		Z_WriteTraceValue(&record[6],  event->offset, 4);
+		Z_WriteTraceValue(&record[10], event->size,   4);
+		fwrite(record, sizeof(record), 1, fp);
+	}
+
+	fclose(fp);
+
+	printf("%lu zone events written to ZTRACE.BIN", (unsigned long)count);
+	if (count != zonetracecount)
+		printf(", the first %lu have been overwritten", (unsigned long)(zonetracecount - count));
+	printf("\n");
+}
+#endif
+
+
+//
+// Free blocks are kept in lists by size class, in paragraphs:
+// one class per size below 16 paragraphs, one per power of two above.
+// The segregated allocator allocates from them,
+// the first fit allocator only uses them to answer Z_IsEnoughFreeMemory.
+//
+#define NUMSIZECLASSES 32
+
+static segment_t freelists[NUMSIZECLASSES];
+
+// The number of PU_CACHE blocks in each size class
+static uint32_t cacheblocks[NUMSIZECLASSES];
+
+#if defined ZONE_LRU
+#define freeLinks(b) (b)
+#else
+// Without the second header paragraph the links are kept after the header,
+// so every block has at least one paragraph after its header
+typedef struct
+{
+    segment_t listnext;
+    segment_t listprev;
+} freelinks_t;
+
+#define freeLinks(b) ((freelinks_t __far*)blockToPointer(b))
+#endif
+
+
+static uint_fast8_t Z_GetSizeClass(uint32_t paragraphs)
+{
+	if (paragraphs < 16)
+		return paragraphs;
+
+	uint_fast8_t sizeclass = 12;
+	while (paragraphs >= 2)
+	{
+		paragraphs >>= 1;
+		sizeclass++;
+	}
+	return sizeclass;
+}
+
+
+static void Z_LinkFreeBlock(memblock_t __far* block)
+{
+	uint_fast8_t sizeclass = Z_GetSizeClass(block->size / PARAGRAPH_SIZE);
+	segment_t    segment   = pointerToSegment(block);
+
+	freeLinks(block)->listprev = 0;
+	freeLinks(block)->listnext = freelists[sizeclass];
+	if (freelists[sizeclass])
+		freeLinks(segmentToPointer(freelists[sizeclass]))->listprev = segment;
+	freelists[sizeclass] = segment;
+}
+
+
+static void Z_UnlinkFreeBlock(memblock_t __far* block)
+{
+	segment_t listnext = freeLinks(block)->listnext;
+	segment_t listprev = freeLinks(block)->listprev;
+
+	if (listprev)
+		freeLinks(segmentToPointer(listprev))->listnext = listnext;
+	else
+		freelists[Z_GetSizeClass(block->size / PARAGRAPH_SIZE)] = listnext;
+
+	if (listnext)
+		freeLinks(segmentToPointer(listnext))->listprev = listprev;
+}
+
+
+#if defined ZONE_LRU
+//
+// Blocks with tag PU_CACHE are kept in a list from least to most recently used,
+// and are purged in that order when no free block is large enough.
+//
+static segment_t lru_oldest;
+static segment_t lru_newest;
+
+
+static void Z_LinkCacheBlock(memblock_t __far* block)
+{
+	segment_t segment = pointerToSegment(block);
+
+	block->listnext = 0;
+	block->listprev = lru_newest;
+	if (lru_newest)
+		segmentToPointer(lru_newest)->listnext = segment;
+	else
+		lru_oldest = segment;
+	lru_newest = segment;
+}
+
+
+static void Z_UnlinkCacheBlock(memblock_t __far* block)
+{
+	if (block->listprev)
+		segmentToPointer(block->listprev)->listnext = block->listnext;
+	else
+		lru_oldest = block->listnext;
+
+	if (block->listnext)
+		segmentToPointer(block->listnext)->listprev = block->listprev;
+	else
+		lru_newest = block->listprev;
+}
+#endif
+
+
+//
+// Z_CheckBlock
+// Checks a block and its link to the next block
+//
+static void Z_CheckBlock(const memblock_t __far* block)
+{
+#if defined ZONEIDCHECK
+    if (block->id != ZONEID)
+        I_Error("Z_CheckHeap: block has id %x instead of ZONEID", block->id);
+#endif
+
+    if (block->next == pointerToSegment(mainzone_sentinal))
+        return;
+
+    if (pointerToSegment(block) + (block->size / PARAGRAPH_SIZE) != block->next)
+        I_Error ("Z_CheckHeap: block size does not touch the next block\n");
+
+    if (segmentToPointer(block->next)->prev != pointerToSegment(block))
+        I_Error ("Z_CheckHeap: next block doesn't have proper back link\n");
+
+    if (!block->user && !segmentToPointer(block->next)->user)
+        I_Error ("Z_CheckHeap: two consecutive free blocks\n");
+
+    if (!block->user && freeLinks(block)->listnext && freeLinks(segmentToPointer(freeLinks(block)->listnext))->listprev != pointerToSegment(block))
+        I_Error ("Z_CheckHeap: next block in free list doesn't have proper back link\n");
+#if defined ZONE_LRU
+    if (block->user && block->tag == PU_CACHE && block->listnext && segmentToPointer(block->listnext)->listprev != pointerToSegment(block))
+        I_Error ("Z_CheckHeap: next block in LRU list doesn't have proper back link\n");
+#endif
+}
+
+
+#if defined CHECKHEAP
+//
+// Z_CheckNeighbours
+// Checks the links between a block that has just changed
+// and the blocks before and after it
+//
+static void Z_CheckNeighbours(const memblock_t __far* block)
+{
+    if (block->prev != pointerToSegment(mainzone_sentinal))
+        Z_CheckBlock(segmentToPointer(block->prev));
+
+    Z_CheckBlock(block);
+
+    if (block->next != pointerToSegment(mainzone_sentinal))
+        Z_CheckBlock(segmentToPointer(block->next));
+}
+#endif
+
+
 //
 // Z_Init
 //
@@ -113,10 +465,10 @@ void Z_Init (void)
 
 	// align blocklist
 	uint_fast8_t i = 0;
-	static uint8_t __far mainzone_sentinal_buffer[PARAGRAPH_SIZE * 2];
-	uint32_t b = (uint32_t) &mainzone_sentinal_buffer[i++];
+	static uint8_t __far mainzone_sentinal_buffer[HEADER_SIZE + PARAGRAPH_SIZE];
+	uintptr_t b = (uintptr_t) &mainzone_sentinal_buffer[i++];
 	while ((b & (PARAGRAPH_SIZE - 1)) != 0)
-		b = (uint32_t) &mainzone_sentinal_buffer[i++];
+		b = (uintptr_t) &mainzone_sentinal_buffer[i++];
 	mainzone_sentinal = (memblock_t __far*)b;
 
 #if defined __WATCOMC__ && defined _M_I86
@@ -129,13 +481,27 @@ void Z_Init (void)
 	mainzone_rover_segment = pointerToSegment(block);
 
 	mainzone_sentinal->tag  = PU_STATIC;
-	mainzone_sentinal->user = (void __far*)mainzone;
+	mainzone_sentinal->user = pointerToUser(mainzone);
 	mainzone_sentinal->next = mainzone_rover_segment;
 	mainzone_sentinal->prev = mainzone_rover_segment;
+#if defined ZONE_COMPACTION
+	mainzone_sentinal->movable = false;
+#endif
+
+#if defined HAVE_MMAP
+	zone_start = (uintptr_t)mainzone;
+	zone_end   = zone_start + heapSize;
+#endif
+
+#if defined INSTRUMENTED
+	zonetracebase = segment;
+	zonetracesize = heapSize / PARAGRAPH_SIZE;
+	atexit(Z_WriteTrace);
+#endif
 
 	block->size = heapSize;
 	block->tag  = 0;
-	block->user = NULL; // NULL indicates a free block.
+	block->user = pointerToUser(NULL); // NULL indicates a free block.
 	block->prev = pointerToSegment(mainzone_sentinal);
 	block->next = block->prev;
 #if defined ZONEIDCHECK
@@ -146,13 +512,16 @@ void Z_Init (void)
 	segment_t addsegment = I_ZoneAdditional(&addMemSize);
 	if (addMemSize)
 	{
-		segment_t romblock_segment = mainzone_rover_segment + heapSize / PARAGRAPH_SIZE - 1;
+		segment_t romblock_segment = mainzone_rover_segment + heapSize / PARAGRAPH_SIZE - HEADER_PARAGRAPHS;
 		memblock_t __far* romblock = segmentToPointer(romblock_segment);
 		romblock->size = (uint32_t)(addsegment - romblock_segment) * PARAGRAPH_SIZE;
 		romblock->tag  = PU_STATIC;
-		romblock->user = (void __far*)mainzone;
+		romblock->user = pointerToUser(mainzone);
 		romblock->next = addsegment;
 		romblock->prev = mainzone_rover_segment;
+#if defined ZONE_COMPACTION
+		romblock->movable = false;
+#endif
 #if defined ZONEIDCHECK
 		romblock->id   = ZONEID;
 #endif
@@ -160,37 +529,76 @@ void Z_Init (void)
 		memblock_t __far* addblock = segmentToPointer(addsegment);
 		addblock->size = addMemSize;
 		addblock->tag  = 0;
-		addblock->user = NULL; // NULL indicates a free block.
+		addblock->user = pointerToUser(NULL); // NULL indicates a free block.
 		addblock->next = block->next; // == pointerToSegment(mainzone_sentinal)
 		addblock->prev = romblock_segment;
 #if defined ZONEIDCHECK
 		addblock->id   = ZONEID;
 #endif
 
-		block->size -= PARAGRAPH_SIZE;
+		block->size -= HEADER_SIZE;
 		block->next = romblock_segment;
+
+#if defined HAVE_MMAP
+		zone_end = (uintptr_t)addblock + addMemSize;
+#endif
+#if defined INSTRUMENTED
+		// the gap between the two parts of the zone is a static block
+		zonetracesize = addsegment - segment + addMemSize / PARAGRAPH_SIZE;
+		Z_Trace(ZT_ALLOC, romblock);
+#endif
+		Z_LinkFreeBlock(addblock);
+		freememory = addblock->size;
 	}
+
+	Z_LinkFreeBlock(block);
+	freememory += block->size;
 }
 
 
 static void Z_ChangeTag(const void __far* ptr, uint_fast8_t tag)
 {
+#if defined HAVE_MMAP
+	if (!Z_IsZoneBlock(ptr))
+		return;
+#endif
+
 #if defined RANGECHECK
-	if ((((uint32_t) ptr) & (PARAGRAPH_SIZE - 1)) != 0)
+	if ((((uintptr_t) ptr) & (PARAGRAPH_SIZE - 1)) != 0)
 		I_Error("Z_ChangeTag: pointer is not aligned: 0x%lx", ptr);
 #endif
 
-#if defined _M_I86
-	memblock_t __far* block = (memblock_t __far*)(((uint32_t)ptr) - 0x00010000);
-#else
-	memblock_t __far* block = (memblock_t __far*)(((uint32_t)ptr) - 0x00010);
-#endif
+	memblock_t __far* block = pointerToBlock(ptr);
 
 #if defined ZONEIDCHECK
 	if (block->id != ZONEID)
 		I_Error("Z_ChangeTag: block has id %x instead of ZONEID", block->id);
 #endif
+
+	if (block->tag == PU_CACHE)
+	{
+		cachememory -= block->size;
+		cacheblocks[Z_GetSizeClass(block->size / PARAGRAPH_SIZE)]--;
+#if defined ZONE_LRU
+		Z_UnlinkCacheBlock(block);
+#endif
+	}
+
+	if (tag == PU_CACHE)
+	{
+		cachememory += block->size;
+		cacheblocks[Z_GetSizeClass(block->size / PARAGRAPH_SIZE)]++;
+#if defined ZONE_LRU
+		// Changing the tag to PU_CACHE again makes it the most recently used block
+		Z_LinkCacheBlock(block);
+#endif
+	}
+
 	block->tag = tag;
+
+#if defined INSTRUMENTED
+	Z_Trace(ZT_TAG, block);
+#endif
 }
 
 
@@ -206,36 +614,52 @@ void Z_ChangeTagToCache(const void __far* ptr)
 }
 
 
-static void Z_FreeBlock(memblock_t __far* block)
+//
+// Z_FreeBlock
+// Returns the free block after merging with its neighbours
+//
+static memblock_t __far* Z_FreeBlock(memblock_t __far* block)
 {
 #if defined ZONEIDCHECK
     if (block->id != ZONEID)
         I_Error("Z_FreeBlock: block has id %x instead of ZONEID", block->id);
 #endif
 
-    if (D_FP_SEG(block->user) != 0)
+    if (D_FP_SEG(userToPointer(block->user)) != 0)
     {
         // far pointers with segment 0 are not user pointers
         // Note: OS-dependend
 
         // clear the user's mark
-        *block->user = NULL;
+        *userToPointer(block->user) = NULL;
+    }
+
+#if defined INSTRUMENTED
+    Z_Trace(ZT_FREE, block);
+#endif
+
+    if (block->tag == PU_CACHE)
+    {
+        cachememory -= block->size;
+        cacheblocks[Z_GetSizeClass(block->size / PARAGRAPH_SIZE)]--;
+#if defined ZONE_LRU
+        Z_UnlinkCacheBlock(block);
+#endif
     }
 
+    freememory += block->size;
+
     // mark as free
-    block->user = NULL;
+    block->user = pointerToUser(NULL);
     block->tag  = 0;
 
 
-#if defined INSTRUMENTED
-    running_count -= block->size;
-    printf("Free: %ld\n", running_count);
-#endif
 
     memblock_t __far* other = segmentToPointer(block->prev);
 
     if (!other->user)
     {
+        Z_UnlinkFreeBlock(other);
         // merge with previous free block
         other->size += block->size;
         other->next  = block->next;
@@ -243,6 +667,10 @@ static void Z_FreeBlock(memblock_t __far* block)
 
         if (pointerToSegment(block) == mainzone_rover_segment)
             mainzone_rover_segment = block->prev; // == pointerToSegment(other);
+#if defined CHECKHEAP
+        if (pointerToSegment(block) == checkheap_segment)
+            checkheap_segment = block->prev;
+#endif
 
         block = other;
     }
@@ -250,6 +678,7 @@ static void Z_FreeBlock(memblock_t __far* block)
     other = segmentToPointer(block->next);
     if (!other->user)
     {
+        Z_UnlinkFreeBlock(other);
         // merge the next free block onto the end
         block->size += other->size;
         block->next  = other->next;
@@ -257,7 +686,19 @@ static void Z_FreeBlock(memblock_t __far* block)
 
         if (pointerToSegment(other) == mainzone_rover_segment)
             mainzone_rover_segment = pointerToSegment(block);
+#if defined CHECKHEAP
+        if (pointerToSegment(other) == checkheap_segment)
+            checkheap_segment = pointerToSegment(block);
+#endif
     }
+
+    Z_LinkFreeBlock(block);
+
+#if defined CHECKHEAP
+    Z_CheckNeighbours(block);
+#endif
+
+    return block;
 }
 
 
@@ -266,16 +707,17 @@ static void Z_FreeBlock(memblock_t __far* block)
 //
 void Z_Free (const void __far* ptr)
 {
+#if defined HAVE_MMAP
+	if (!Z_IsZoneBlock(ptr))
+		return;
+#endif
+
 #if defined RANGECHECK
-	if ((((uint32_t) ptr) & (PARAGRAPH_SIZE - 1)) != 0)
+	if ((((uintptr_t) ptr) & (PARAGRAPH_SIZE - 1)) != 0)
 		I_Error("Z_Free: pointer is not aligned: 0x%lx", ptr);
 #endif
 
-#if defined _M_I86
-	memblock_t __far* block = (memblock_t __far*)(((uint32_t)ptr) - 0x00010000);
-#else
-	memblock_t __far* block = (memblock_t __far*)(((uint32_t)ptr) - 0x00010);
-#endif
+	memblock_t __far* block = pointerToBlock(ptr);
 
 	Z_FreeBlock(block);
 }
@@ -285,56 +727,373 @@ uint32_t Z_GetLargestFreeBlockSize(void)
 {
 	uint32_t largestFreeBlockSize = 0;
 
-	segment_t mainzone_sentinal_segment = pointerToSegment(mainzone_sentinal);
+	uint_fast8_t sizeclass = NUMSIZECLASSES;
+	while (sizeclass-- > 0)
+	{
+		// the largest block is in the highest class that has any
+		for (segment_t segment = freelists[sizeclass]; segment; segment = freeLinks(segmentToPointer(segment))->listnext)
+			if (segmentToPointer(segment)->size > largestFreeBlockSize)
+				largestFreeBlockSize = segmentToPointer(segment)->size;
 
-	for (memblock_t __far* block = segmentToPointer(mainzone_sentinal->next); pointerToSegment(block) != mainzone_sentinal_segment; block = segmentToPointer(block->next))
-		if (!block->user && block->size > largestFreeBlockSize)
-			largestFreeBlockSize = block->size;
+		if (largestFreeBlockSize)
+			break;
+	}
 
 	return largestFreeBlockSize;
 }
 
 static uint32_t Z_GetTotalFreeMemory(void)
 {
-	uint32_t totalFreeMemory = 0;
+	return freememory;
+}
+
 
-	segment_t mainzone_sentinal_segment = pointerToSegment(mainzone_sentinal);
+#define MINFRAGMENT		64
 
-	for (memblock_t __far* block = segmentToPointer(mainzone_sentinal->next); pointerToSegment(block) != mainzone_sentinal_segment; block = segmentToPointer(block->next))
-		if (!block->user)
-			totalFreeMemory += block->size;
 
-	return totalFreeMemory;
+//
+// Z_AllocateBlock
+// Splits off the unused end of a free block and marks it as used.
+//
+static void __far* Z_AllocateBlock(memblock_t __far* base, uint32_t size, int8_t tag, void __far*__far* user)
+{
+    Z_UnlinkFreeBlock(base);
+
+    int32_t newblock_size = base->size - size;
+    if (newblock_size > MINFRAGMENT)
+    {
+        // there will be a free fragment after the allocated block
+        segment_t base_segment     = pointerToSegment(base);
+        segment_t newblock_segment = base_segment + (size / PARAGRAPH_SIZE);
+
+        memblock_t __far* newblock = segmentToPointer(newblock_segment);
+        newblock->size = newblock_size;
+        newblock->tag  = 0;
+        newblock->user = pointerToUser(NULL); // NULL indicates free block.
+        newblock->next = base->next;
+        newblock->prev = base_segment;
+#if defined ZONEIDCHECK
+        newblock->id   = ZONEID;
+#endif
+
+        segmentToPointer(base->next)->prev = newblock_segment;
+        base->size = size;
+        base->next = newblock_segment;
+
+        Z_LinkFreeBlock(newblock);
+    }
+
+    freememory -= base->size;
+
+    base->tag  = tag;
+#if defined ZONE_COMPACTION
+    base->movable = false;
+#endif
+    if (user)
+        base->user = pointerToUser(user);
+    else
+        base->user = pointerToUser(D_MK_FP(0,2)); // unowned
+#if defined ZONEIDCHECK
+    base->id  = ZONEID;
+#endif
+
+    // next allocation will start looking here
+    mainzone_rover_segment = base->next;
+
+#if defined CHECKHEAP
+    Z_CheckNeighbours(base);
+#endif
+
+#if defined INSTRUMENTED
+    Z_Trace(ZT_ALLOC, base);
+#endif
+
+    return blockToPointer(base);
+}
+
+
+#if defined ZONE_LRU
+//
+// Z_PurgeCacheBlocks
+// Purges cache blocks, least recently used first,
+// until one of them leaves a free block big enough.
+//
+static memblock_t __far* Z_PurgeCacheBlocks(uint32_t size)
+{
+    while (lru_oldest)
+    {
+        memblock_t __far* block = Z_FreeBlock(segmentToPointer(lru_oldest));
+        if (block->size >= size)
+            return block;
+    }
+
+    return NULL;
+}
+
+// The rover leaves cache blocks to Z_PurgeCacheBlocks
+#define PU_ROVERPURGELEVEL (PU_CACHE + 1)
+#else
+#define PU_ROVERPURGELEVEL PU_PURGELEVEL
+#endif
+
+
+#if defined ZONE_COMPACTION
+//
+// Compaction
+// Cache blocks, and level blocks allocated with Z_MallocLevelMovable,
+// are only referenced through their user, so they can be moved
+// toward the start of the heap, joining the free blocks they separate.
+//
+static boolean Z_IsMovable(const memblock_t __far* block, boolean levelblocks)
+{
+    if (!block->user || D_FP_SEG(userToPointer(block->user)) == 0)
+        return false;
+
+    if (block->tag == PU_CACHE)
+        return true;
+
+    return levelblocks && block->movable;
+}
+
+
+static void Z_MoveParagraphs(segment_t dest, segment_t src, uint32_t size)
+{
+    // dest is below src, so copying forward in chunks is safe
+    while (size)
+    {
+        uint16_t chunk = size > 0x8000 ? 0x8000 : size;
+        _fmemmove(segmentToPointer(dest), segmentToPointer(src), chunk);
+        dest += chunk / PARAGRAPH_SIZE;
+        src  += chunk / PARAGRAPH_SIZE;
+        size -= chunk;
+    }
+}
+
+
+//
+// Z_SlideBlock
+// Swaps a free block with the movable block after it.
+// Returns the free block, merged with the free block after it.
+//
+static memblock_t __far* Z_SlideBlock(memblock_t __far* freeblock, memblock_t __far* block)
+{
+    uint32_t  freesize      = freeblock->size;
+    segment_t prev_segment  = freeblock->prev;
+    segment_t next_segment  = block->next;
+    segment_t block_segment = pointerToSegment(block);
+
+    Z_UnlinkFreeBlock(freeblock);
+
+#if defined INSTRUMENTED
+    Z_Trace(ZT_MOVEFROM, block);
+#endif
+
+    segment_t moved_segment = pointerToSegment(freeblock);
+    Z_MoveParagraphs(moved_segment, block_segment, block->size);
+
+    memblock_t __far* moved = freeblock;
+    moved->prev = prev_segment;
+    *userToPointer(moved->user) = blockToPointer(moved);
+
+#if defined INSTRUMENTED
+    Z_Trace(ZT_MOVETO, moved);
+#endif
+
+    if (moved->tag == PU_CACHE)
+    {
+        // its neighbours in the LRU list still point to the old place
+        if (moved->listprev)
+            segmentToPointer(moved->listprev)->listnext = moved_segment;
+        else
+            lru_oldest = moved_segment;
+
+        if (moved->listnext)
+            segmentToPointer(moved->listnext)->listprev = moved_segment;
+        else
+            lru_newest = moved_segment;
+    }
+
+    segment_t newblock_segment = moved_segment + moved->size / PARAGRAPH_SIZE;
+    memblock_t __far* newblock = segmentToPointer(newblock_segment);
+    newblock->size = freesize;
+    newblock->tag  = 0;
+    newblock->user = pointerToUser(NULL); // NULL indicates free block.
+    newblock->next = next_segment;
+    newblock->prev = moved_segment;
+#if defined ZONEIDCHECK
+    newblock->id   = ZONEID;
+#endif
+
+    moved->next = newblock_segment;
+    segmentToPointer(next_segment)->prev = newblock_segment;
+
+    if (mainzone_rover_segment == block_segment)
+        mainzone_rover_segment = newblock_segment;
+#if defined CHECKHEAP
+    if (checkheap_segment == block_segment)
+        checkheap_segment = newblock_segment;
+#endif
+
+    memblock_t __far* other = segmentToPointer(next_segment);
+    if (!other->user)
+    {
+        Z_UnlinkFreeBlock(other);
+        // merge the next free block onto the end
+        newblock->size += other->size;
+        newblock->next  = other->next;
+        segmentToPointer(newblock->next)->prev = newblock_segment;
+
+        if (mainzone_rover_segment == next_segment)
+            mainzone_rover_segment = newblock_segment;
+#if defined CHECKHEAP
+        if (checkheap_segment == next_segment)
+            checkheap_segment = newblock_segment;
+#endif
+    }
+
+    Z_LinkFreeBlock(newblock);
+
+#if defined CHECKHEAP
+    Z_CheckNeighbours(newblock);
+#endif
+
+    return newblock;
+}
+
+
+//
+// Z_CompactBlocks
+// Slides movable blocks down into the free blocks before them,
+// until a free block of at least size bytes is left behind.
+//
+static memblock_t __far* Z_CompactBlocks(boolean levelblocks, uint32_t size)
+{
+    segment_t mainzone_sentinal_segment = pointerToSegment(mainzone_sentinal);
+
+    for (memblock_t __far* block = segmentToPointer(mainzone_sentinal->next); pointerToSegment(block) != mainzone_sentinal_segment; block = segmentToPointer(block->next))
+    {
+        if (block->user)
+            continue;
+
+        memblock_t __far* next;
+        while (next = segmentToPointer(block->next), Z_IsMovable(next, levelblocks))
+            block = Z_SlideBlock(block, next);
+
+        if (block->size >= size)
+            return block;
+    }
+
+    return NULL;
 }
 
 
+//
+// Z_Compact
+// Moves the level's textures and the cached lumps together,
+// to be called when nothing holds pointers to them but their users.
+//
+void Z_Compact(void)
+{
+    Z_CompactBlocks(true, UINT32_MAX);
+}
+#endif
+
+
+//
+// Z_GetBlockSize
+// Returns the size of the block, including the header,
+// that holds an allocation of size bytes
+//
+static uint32_t Z_GetBlockSize(uint32_t size)
+{
+    size = (size + (PARAGRAPH_SIZE - 1)) & ~(PARAGRAPH_SIZE - 1);
+
+#if !defined ZONE_LRU
+    // room for the free list links once the block is freed
+    if (size == 0)
+        size = PARAGRAPH_SIZE;
+#endif
+
+    // account for size of block header
+    return size + HEADER_SIZE;
+}
+
+
+static memblock_t __far* Z_FindFreeBlock(uint32_t size)
+{
+    for (uint_fast8_t sizeclass = Z_GetSizeClass(size / PARAGRAPH_SIZE); sizeclass < NUMSIZECLASSES; sizeclass++)
+    {
+        // only blocks of the first class can be too small
+        for (segment_t segment = freelists[sizeclass]; segment; )
+        {
+            memblock_t __far* block = segmentToPointer(segment);
+            if (block->size >= size)
+                return block;
+
+            segment = freeLinks(block)->listnext;
+        }
+    }
+
+    return NULL;
+}
+
+
+#if !defined ZONE_SEGREGATED
+//
+// Z_GetRoverBase
+// Returns the block where the first fit allocator starts scanning:
+// the rover, or the free block behind it
+//
+static memblock_t __far* Z_GetRoverBase(void)
+{
+    memblock_t __far* base = segmentToPointer(mainzone_rover_segment);
+
+    memblock_t __far* previous_block = segmentToPointer(base->prev);
+    if (!previous_block->user)
+        base = previous_block;
+
+    return base;
+}
+#endif
+
+
 //
 // Z_TryMalloc
 // You can pass a NULL user if the tag is < PU_PURGELEVEL.
 // Because Z_TryMalloc is static, we can control the input and we can make sure tag is always < PU_PURGELEVEL.
 //
-#define MINFRAGMENT		64
+#if defined ZONE_SEGREGATED
+static void __far* Z_TryMalloc(uint32_t size, int8_t tag, void __far*__far* user)
+{
+    size = Z_GetBlockSize(size);
 
+    memblock_t __far* base = Z_FindFreeBlock(size);
+#if defined ZONE_COMPACTION
+    if (!base && freememory >= size)
+        base = Z_CompactBlocks(false, size);
+#endif
+    if (!base)
+    {
+        base = Z_PurgeCacheBlocks(size);
+        if (!base)
+            return NULL;
+    }
 
-static void __far* Z_TryMalloc(uint16_t size, int8_t tag, void __far*__far* user)
+    return Z_AllocateBlock(base, size, tag, user);
+}
+#else
+static void __far* Z_TryMalloc(uint32_t size, int8_t tag, void __far*__far* user)
 {
-    size = (size + (PARAGRAPH_SIZE - 1)) & ~(PARAGRAPH_SIZE - 1);
-
     // scan through the block list,
     // looking for the first free block
     // of sufficient size,
     // throwing out any purgable blocks along the way.
 
-    // account for size of block header
-    size += PARAGRAPH_SIZE;
+    size = Z_GetBlockSize(size);
 
     // if there is a free block behind the rover,
     //  back up over them
-    memblock_t __far* base = segmentToPointer(mainzone_rover_segment);
-
-    memblock_t __far* previous_block = segmentToPointer(base->prev);
-    if (!previous_block->user)
-        base = previous_block;
+    memblock_t __far* base = Z_GetRoverBase();
 
     memblock_t __far* rover   = base;
     segment_t   start_segment = base->prev;
@@ -344,12 +1103,22 @@ static void __far* Z_TryMalloc(uint16_t size, int8_t tag, void __far*__far* user
         if (pointerToSegment(rover) == start_segment)
         {
             // scanned all the way around the list
+#if defined ZONE_COMPACTION
+            base = freememory >= size ? Z_CompactBlocks(false, size) : NULL;
+            if (base)
+                break;
+#endif
+#if defined ZONE_LRU
+            base = Z_PurgeCacheBlocks(size);
+            if (base)
+                break;
+#endif
             return NULL;
         }
 
         if (rover->user)
         {
-            if (rover->tag < PU_PURGELEVEL)
+            if (rover->tag < PU_ROVERPURGELEVEL)
             {
                 // hit a block that can't be purged,
                 //  so move base past it
@@ -372,69 +1141,19 @@ static void __far* Z_TryMalloc(uint16_t size, int8_t tag, void __far*__far* user
     } while (base->user || base->size < size);
     // found a block big enough
 
-    int32_t newblock_size = base->size - size;
-    if (newblock_size > MINFRAGMENT)
-    {
-        // there will be a free fragment after the allocated block
-        segment_t base_segment     = pointerToSegment(base);
-        segment_t newblock_segment = base_segment + (size / PARAGRAPH_SIZE);
-
-        memblock_t __far* newblock = segmentToPointer(newblock_segment);
-        newblock->size = newblock_size;
-        newblock->tag  = 0;
-        newblock->user = NULL; // NULL indicates free block.
-        newblock->next = base->next;
-        newblock->prev = base_segment;
-#if defined ZONEIDCHECK
-        newblock->id   = ZONEID;
-#endif
-
-        segmentToPointer(base->next)->prev = newblock_segment;
-        base->size = size;
-        base->next = newblock_segment;
-    }
-
-    base->tag  = tag;
-    if (user)
-        base->user = user;
-    else
-        base->user = (void __far*__far*) D_MK_FP(0,2); // unowned
-#if defined ZONEIDCHECK
-    base->id  = ZONEID;
-#endif
-
-    // next allocation will start looking here
-    mainzone_rover_segment = base->next;
-
-#if defined INSTRUMENTED
-    running_count += base->size;
-    printf("Alloc: %ld (%ld)\n", base->size, running_count);
-#endif
-
-#if defined _M_I86
-    memblock_t __far* block = (memblock_t __far*)(((uint32_t)base) + 0x00010000);
-#else
-    memblock_t __far* block = (memblock_t __far*)(((uint32_t)base) + 0x00010);
-#endif
-
-    return block;
+    return Z_AllocateBlock(base, size, tag, user);
 }
+#endif
 
 
-static void __far* Z_Malloc(uint16_t size, int8_t tag, void __far*__far* user) {
+static void __far* Z_Malloc(uint32_t size, int8_t tag, void __far*__far* user) {
 	void __far* ptr = Z_TryMalloc(size, tag, user);
 	if (!ptr)
-		I_Error ("Z_Malloc: failed to allocate %u B, max free block %li B, total free %li", size, Z_GetLargestFreeBlockSize(), Z_GetTotalFreeMemory());
+		I_Error ("Z_Malloc: failed to allocate %lu B, max free block %li B, total free %li", (unsigned long) size, Z_GetLargestFreeBlockSize(), Z_GetTotalFreeMemory());
 	return ptr;
 }
 
 
-static void __far* Z_TryMallocStatic(uint16_t size)
-{
-	return Z_TryMalloc(size, PU_STATIC, NULL);
-}
-
-
 void __far* Z_MallocStatic(uint16_t size)
 {
 	return Z_Malloc(size, PU_STATIC, NULL);
@@ -453,6 +1172,21 @@ void __far* Z_MallocLevel(uint16_t size, void __far*__far* user)
 }
 
 
+//
+// Z_MallocLevelMovable
+// The block can be moved by Z_Compact,
+// so the user has to be the only pointer to it.
+//
+void __far* Z_MallocLevelMovable(uint16_t size, void __far*__far* user)
+{
+	void __far* ptr = Z_Malloc(size, PU_LEVEL, user);
+#if defined ZONE_COMPACTION
+	pointerToBlock(ptr)->movable = true;
+#endif
+	return ptr;
+}
+
+
 void __far* Z_CallocLevel(uint16_t size)
 {
     void __far* ptr = Z_Malloc(size, PU_LEVEL, NULL);
@@ -461,6 +1195,17 @@ void __far* Z_CallocLevel(uint16_t size)
 }
 
 
+#if !defined _M_I86
+// Blocks of 64 kB and more are only addressable on flat memory models
+void __far* Z_CallocLevelLarge(uint32_t size)
+{
+    void __far* ptr = Z_Malloc(size, PU_LEVEL, NULL);
+    _fmemset(ptr, 0, size);
+    return ptr;
+}
+#endif
+
+
 void __far* Z_CallocLevSpec(uint16_t size)
 {
 	void __far* ptr = Z_Malloc(size, PU_LEVSPEC, NULL);
@@ -469,15 +1214,70 @@ void __far* Z_CallocLevSpec(uint16_t size)
 }
 
 
+//
+// Z_IsEnoughFreeMemory
+// Tells whether Z_Malloc would succeed, possibly by compacting or purging cached blocks,
+// without touching the heap.
+//
 boolean Z_IsEnoughFreeMemory(uint16_t size)
 {
-	const uint8_t __far* ptr = Z_TryMallocStatic(size);
-	if (ptr)
-	{
-		Z_Free(ptr);
+	uint32_t blocksize = Z_GetBlockSize(size);
+
+	if (Z_FindFreeBlock(blocksize))
 		return true;
-	} else
+
+	if (freememory + cachememory < blocksize)
 		return false;
+
+	// purging a cached block of a larger size class frees enough
+	uint_fast8_t blocksizeclass = Z_GetSizeClass(blocksize / PARAGRAPH_SIZE);
+
+	uint32_t largercacheblocks = 0;
+	for (uint_fast8_t sizeclass = blocksizeclass + 1; sizeclass < NUMSIZECLASSES; sizeclass++)
+		largercacheblocks += cacheblocks[sizeclass];
+
+#if defined ZONE_LRU
+	// purging the whole LRU list would free any of them
+	memblock_t __far* block = segmentToPointer(mainzone_sentinal->next);
+	segment_t start_segment = pointerToSegment(mainzone_sentinal);
+#else
+	// in the order Z_TryMalloc would scan them,
+	// which stops before the block behind the base
+	memblock_t __far* block = Z_GetRoverBase();
+	segment_t start_segment = block->prev;
+
+	const memblock_t __far* start_block = segmentToPointer(start_segment);
+	if (start_block->user && start_block->tag == PU_CACHE && Z_GetSizeClass(start_block->size / PARAGRAPH_SIZE) > blocksizeclass)
+		largercacheblocks--;
+#endif
+
+	if (largercacheblocks)
+		return true;
+
+	// only smaller blocks are left,
+	// look for enough free and purgeable blocks in a row
+	uint32_t run = 0;
+
+	for ( ; pointerToSegment(block) != start_segment; block = segmentToPointer(block->next))
+	{
+		if (!block->user || block->tag >= PU_PURGELEVEL)
+		{
+			run += block->size;
+			if (run >= blocksize)
+				return true;
+		}
+#if defined ZONE_COMPACTION
+		else if (Z_IsMovable(block, false))
+		{
+			// Z_CompactBlocks slides it out of the way,
+			// joining the free memory on both sides
+		}
+#endif
+		else
+			run = 0;
+	}
+
+	return false;
 }
 
 
@@ -511,26 +1311,40 @@ void Z_CheckHeap (void)
 {
     segment_t mainzone_sentinal_segment = pointerToSegment(mainzone_sentinal);
 
-    for (memblock_t __far* block = segmentToPointer(mainzone_sentinal->next); ; block = segmentToPointer(block->next))
-    {
-        if (block->next == mainzone_sentinal_segment)
-        {
-            // all blocks have been hit
-            break;
-        }
+    for (memblock_t __far* block = segmentToPointer(mainzone_sentinal->next); pointerToSegment(block) != mainzone_sentinal_segment; block = segmentToPointer(block->next))
+        Z_CheckBlock(block);
+}
 
-#if defined ZONEIDCHECK
-        if (block->id != ZONEID)
-            I_Error("Z_CheckHeap: block has id %x instead of ZONEID", block->id);
+
+#if defined CHECKHEAP
+#if !defined CHECKHEAP_BLOCKS
+#define CHECKHEAP_BLOCKS 32
 #endif
 
-        if (pointerToSegment(block) + (block->size / PARAGRAPH_SIZE) != block->next)
-            I_Error ("Z_CheckHeap: block size does not touch the next block\n");
+//
+// Z_CheckHeapIncremental
+// Checks the next CHECKHEAP_BLOCKS blocks,
+// so the whole heap is checked every few tics.
+//
+void Z_CheckHeapIncremental(void)
+{
+    segment_t mainzone_sentinal_segment = pointerToSegment(mainzone_sentinal);
+
+    if (!checkheap_segment)
+        checkheap_segment = mainzone_sentinal->next;
 
-        if (segmentToPointer(block->next)->prev != pointerToSegment(block))
-            I_Error ("Z_CheckHeap: next block doesn't have proper back link\n");
+    for (uint_fast8_t i = 0; i < CHECKHEAP_BLOCKS; i++)
+    {
+        const memblock_t __far* block = segmentToPointer(checkheap_segment);
+        Z_CheckBlock(block);
 
-        if (!block->user && !segmentToPointer(block->next)->user)
-            I_Error ("Z_CheckHeap: two consecutive free blocks\n");
+        checkheap_segment = block->next;
+        if (checkheap_segment == mainzone_sentinal_segment)
+        {
+            // start over next tic
+            checkheap_segment = 0;
+            break;
+        }
     }
 }
+#endif
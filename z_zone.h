@@ -35,12 +35,25 @@ uint32_t Z_GetLargestFreeBlockSize(void);
 void __far* Z_MallocStatic(uint16_t size);
 void __far* Z_MallocStaticWithUser(uint16_t size, void __far*__far* user); 
 void __far* Z_MallocLevel(uint16_t size, void __far*__far* user);
+void __far* Z_MallocLevelMovable(uint16_t size, void __far*__far* user);
 void __far* Z_CallocLevel(uint16_t size);
+#if !defined _M_I86
+void __far* Z_CallocLevelLarge(uint32_t size);
+#endif
 void __far* Z_CallocLevSpec(uint16_t size);
 void Z_ChangeTagToStatic(const void __far* ptr);
 void Z_ChangeTagToCache(const void __far* ptr);
 void Z_Free(const void __far* ptr);
 void Z_FreeTags(void);
 void Z_CheckHeap(void);
+#if defined CHECKHEAP
+void Z_CheckHeapIncremental(void);
+#endif
+#if defined ZONE_COMPACTION
+void Z_Compact(void);
+#endif
+#if defined INSTRUMENTED
+void Z_TraceLump(int16_t num);
+#endif
 
 #endif
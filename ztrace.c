@@ -0,0 +1,308 @@
+/*-----------------------------------------------------------------------------
+ *
+ *
+ *  Copyright (C) 2024 Frenkel Smeijers
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Reads the zone allocation trace ZTRACE.BIN of an INSTRUMENTED build
+ *      and prints the occupancy and fragmentation of the heap after every tic
+ *      as CSV, followed by a summary on stderr.
+ *
+ *      The file starts with ZONETRACE_MAGIC, the size of the zone in paragraphs,
+ *      the number of events recorded and the number of events in the file,
+ *      all little-endian 32-bit.
+ *      Each event is the tic (16 bits), the lump number or -1 (16 bits),
+ *      the operation (8 bits), the tag (8 bits), the offset of the block
+ *      in paragraphs (32 bits) and its size in bytes (32 bits).
+ *
+ *      This is a host tool, it is not part of the game.
+ *
+ *-----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ZONETRACE_MAGIC "ZTRACE1"
+#define PARAGRAPH_SIZE 16
+
+enum
+{
+	ZT_ALLOC,
+	ZT_FREE,
+	ZT_TAG,
+	ZT_MOVEFROM,
+	ZT_MOVETO
+};
+
+#define NUMTAGS 5
+
+static const char* const tagnames[NUMTAGS] = {"free", "static", "level", "levspec", "cache"};
+
+typedef struct
+{
+	uint32_t offset;
+	uint32_t size;
+	int16_t  lump;
+	uint8_t  tag;
+} block_t;
+
+// sorted by offset
+static block_t* blocks;
+static size_t   numblocks;
+static size_t   maxblocks;
+
+static uint64_t livebytes[NUMTAGS];
+static uint64_t peakbytes[NUMTAGS];
+static uint64_t allocs[NUMTAGS];
+static uint64_t allocbytes[NUMTAGS];
+
+
+static uint32_t ReadValue(const uint8_t* p, int bytes)
+{
+	uint32_t value = 0;
+	while (bytes--)
+		value = value << 8 | p[bytes];
+	return value;
+}
+
+
+static size_t FindBlock(uint32_t offset)
+{
+	size_t lo = 0, hi = numblocks;
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (blocks[mid].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+static void InsertBlock(uint32_t offset, uint32_t size, uint8_t tag, int16_t lump)
+{
+	if (numblocks == maxblocks)
+	{
+		maxblocks = maxblocks ? maxblocks * 2 : 1024;
+		blocks = realloc(blocks, maxblocks * sizeof(*blocks));
+		if (!blocks)
+		{
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+
+	size_t i = FindBlock(offset);
+	memmove(&blocks[i + 1], &blocks[i], (numblocks - i) * sizeof(*blocks));
+	blocks[i].offset = offset;
+	blocks[i].size   = size;
+	blocks[i].tag    = tag < NUMTAGS ? tag : 0;
+	blocks[i].lump   = lump;
+	numblocks++;
+
+	livebytes[blocks[i].tag] += size;
+	if (livebytes[blocks[i].tag] > peakbytes[blocks[i].tag])
+		peakbytes[blocks[i].tag] = livebytes[blocks[i].tag];
+}
+
+
+// Returns NULL for blocks allocated before the first event in the file
+static block_t* GetBlock(uint32_t offset)
+{
+	size_t i = FindBlock(offset);
+	return i < numblocks && blocks[i].offset == offset ? &blocks[i] : NULL;
+}
+
+
+static void RemoveBlock(block_t* block)
+{
+	livebytes[block->tag] -= block->size;
+
+	size_t i = block - blocks;
+	memmove(&blocks[i], &blocks[i + 1], (numblocks - i - 1) * sizeof(*blocks));
+	numblocks--;
+}
+
+
+static void PrintTic(uint32_t run, int16_t tic, uint32_t zonesize, uint32_t* minlargest)
+{
+	uint64_t used = 0;
+	for (int t = 1; t < NUMTAGS; t++)
+		used += livebytes[t];
+
+	uint64_t freebytes = (uint64_t)zonesize * PARAGRAPH_SIZE - used;
+
+	// the free blocks are the gaps between the used blocks
+	uint64_t largest    = 0;
+	uint32_t freeblocks = 0;
+	uint32_t offset     = 0;
+	for (size_t i = 0; i <= numblocks; i++)
+	{
+		uint32_t end = i < numblocks ? blocks[i].offset : zonesize;
+		if (end > offset)
+		{
+			uint64_t gap = (uint64_t)(end - offset) * PARAGRAPH_SIZE;
+			if (gap > largest)
+				largest = gap;
+			freeblocks++;
+		}
+
+		if (i < numblocks)
+			offset = blocks[i].offset + blocks[i].size / PARAGRAPH_SIZE;
+	}
+
+	if (largest < *minlargest)
+		*minlargest = largest;
+
+	printf("%u,%d,%llu,%llu,%llu,%llu,%llu,%llu,%u,%.1f\n", run, tic,
+		(unsigned long long)livebytes[1], (unsigned long long)livebytes[2],
+		(unsigned long long)livebytes[3], (unsigned long long)livebytes[4],
+		(unsigned long long)freebytes, (unsigned long long)largest, freeblocks,
+		freebytes ? 100.0 * (freebytes - largest) / freebytes : 0.0);
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* filename = argc > 1 ? argv[1] : "ZTRACE.BIN";
+
+	FILE* fp = fopen(filename, "rb");
+	if (!fp)
+	{
+		fprintf(stderr, "Can't open %s\n", filename);
+		return 1;
+	}
+
+	uint8_t header[sizeof(ZONETRACE_MAGIC) - 1 + 3 * 4];
+	if (fread(header, sizeof(header), 1, fp) != 1 || memcmp(header, ZONETRACE_MAGIC, sizeof(ZONETRACE_MAGIC) - 1))
+	{
+		fprintf(stderr, "%s is not a zone trace\n", filename);
+		return 1;
+	}
+
+	uint32_t zonesize = ReadValue(&header[sizeof(ZONETRACE_MAGIC) - 1 + 0], 4);
+	uint32_t recorded = ReadValue(&header[sizeof(ZONETRACE_MAGIC) - 1 + 4], 4);
+	uint32_t count    = ReadValue(&header[sizeof(ZONETRACE_MAGIC) - 1 + 8], 4);
+
+	printf("run,tic,static,level,levspec,cache,free,largest,freeblocks,fragmentation\n");
+
+	uint32_t run        = 0;
+	int16_t  tic        = 0;
+	uint32_t minlargest = UINT32_MAX;
+	int16_t  movinglump = -1;
+
+	// the highest address a block that can't be purged reaches
+	uint32_t pinnedend = 0;
+
+	for (uint32_t e = 0; e < count; e++)
+	{
+		uint8_t record[14];
+		if (fread(record, sizeof(record), 1, fp) != 1)
+		{
+			fprintf(stderr, "%s ends after %u of %u events\n", filename, e, count);
+			break;
+		}
+
+		int16_t  evtic  = ReadValue(&record[0], 2);
+		int16_t  lump   = ReadValue(&record[2], 2);
+		uint8_t  op     = record[4];
+		uint8_t  tag    = record[5];
+		uint32_t offset = ReadValue(&record[6],  4);
+		uint32_t size   = ReadValue(&record[10], 4);
+
+		if (e == 0)
+			tic = evtic;
+		else if (evtic != tic)
+		{
+			PrintTic(run, tic, zonesize, &minlargest);
+
+			// the timedemo starts over
+			if (evtic < tic)
+				run++;
+
+			tic = evtic;
+		}
+
+		block_t* block;
+		switch (op)
+		{
+			case ZT_ALLOC:
+				InsertBlock(offset, size, tag, lump);
+				if (tag < NUMTAGS)
+				{
+					allocs[tag]++;
+					allocbytes[tag] += size;
+				}
+				break;
+
+			case ZT_FREE:
+				block = GetBlock(offset);
+				if (block)
+					RemoveBlock(block);
+				break;
+
+			case ZT_TAG:
+				block = GetBlock(offset);
+				if (block)
+				{
+					lump = block->lump;
+					RemoveBlock(block);
+					InsertBlock(offset, size, tag, lump);
+				}
+				break;
+
+			case ZT_MOVEFROM:
+				block = GetBlock(offset);
+				movinglump = block ? block->lump : -1;
+				if (block)
+					RemoveBlock(block);
+				break;
+
+			case ZT_MOVETO:
+				InsertBlock(offset, size, tag, movinglump);
+				break;
+		}
+
+		if ((op == ZT_ALLOC || op == ZT_TAG) && tag != 4 && offset + size / PARAGRAPH_SIZE > pinnedend)
+			pinnedend = offset + size / PARAGRAPH_SIZE;
+	}
+
+	if (count)
+		PrintTic(run, tic, zonesize, &minlargest);
+
+	fclose(fp);
+
+	fprintf(stderr, "Zone of %u bytes, %u events", zonesize * PARAGRAPH_SIZE, count);
+	if (count != recorded)
+		fprintf(stderr, ", the first %u have been overwritten and the blocks they allocated are missing", recorded - count);
+	fprintf(stderr, "\n");
+
+	fprintf(stderr, "%-8s %10s %12s %12s\n", "tag", "allocs", "bytes", "peak bytes");
+	for (int t = 1; t < NUMTAGS; t++)
+		fprintf(stderr, "%-8s %10llu %12llu %12llu\n", tagnames[t], (unsigned long long)allocs[t], (unsigned long long)allocbytes[t], (unsigned long long)peakbytes[t]);
+
+	fprintf(stderr, "Blocks that can't be purged reach up to byte %u of the zone\n", pinnedend * PARAGRAPH_SIZE);
+	if (minlargest != UINT32_MAX)
+		fprintf(stderr, "Smallest largest free block at the end of a tic: %u bytes\n", minlargest);
+
+	return 0;
+}